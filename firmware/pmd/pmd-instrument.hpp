@@ -1,16 +1,22 @@
-#ifndef PLATFORM_SDS_INSTRUMENT_H
-#define PLATFORM_SDS_INSTRUMENT_H
+#ifndef PLATFORM_PMD_INSTRUMENT_H
+#define PLATFORM_PMD_INSTRUMENT_H
 
 #include "../../lib/attackordecay.hpp"
 #include "../../lib/buttons.hpp"
+#include "../../lib/control.hpp"
 #include "../../lib/metro.hpp"
 #include "../../lib/oscillator.hpp"
 #include "../../lib/pm2.hpp"
+#include "../../lib/profile.hpp"
 #include "../../lib/quantize.hpp"
+#include "../../lib/random.hpp"
 #include "../../lib/sequencer.hpp"
+#include "../../lib/statechannel.hpp"
 #include "pmd-controller.hpp"
 #include "pmd-state.hpp"
 
+#include "pico/rand.h"
+
 namespace platform {
 
 struct PMDInstrument {
@@ -18,12 +24,14 @@ struct PMDInstrument {
     : controller{pots},
       bootButton{bootButton},
       isExternalClock{false},
+      tickFrequencyChanged{false},
       externalClockTicks{0},
       clockTicks{0},
       samplesSinceLastClockTick{0},
       externalClockFrequency{0.f},
       previousClockState{false},
       started{false},
+      lfoEnvelopeValue{0.f},
       envelopeValueSample{0.f} {};
 
   void init(float sampleRateIn) {
@@ -33,18 +41,20 @@ struct PMDInstrument {
       pm2[i].init(sampleRate);
     }
     clock.init(getTickFrequency(), sampleRate);
-    lfoEnvelope.init(sampleRate);
+    // the LFOs only modulate parameters, so they run at control rate
+    lfoEnvelope.init(controlRate(sampleRate));
     lfoEnvelope.setWaveform(Oscillator::WAVE_SIN);
     lfoEnvelope.setFreq(0.5f); // 0.5 Hz
     lfoEnvelope.setAmp(1.f);
-    lfoTembre.init(sampleRate);
+    lfoTembre.init(controlRate(sampleRate));
     lfoTembre.setWaveform(Oscillator::WAVE_SIN);
     lfoTembre.setFreq(0.5f); // 0.5 Hz
     lfoTembre.setAmp(1.f);
 
     // start the sequencer with random seeds every time we reset
-    sequencer.setCVSeed(rand());
-    sequencer.setCVPaletteSeed(rand());
+    random.seed(get_rand_32());
+    sequencer.setCVSeed(random.next());
+    sequencer.setCVPaletteSeed(random.next());
   }
 
   float getTickFrequency() {
@@ -72,14 +82,14 @@ struct PMDInstrument {
   }
 
   bool isClockTick() {
+    PROFILE_SCOPE("clock");
     samplesSinceLastClockTick++;
 
     bool tick = false;
+    tickFrequencyChanged = false;
 
-    bool clockConnectedState = gpio_get(CLOCK_IN_CONNECTED_PIN);
-    if (clockConnectedState) {
+    if (isExternalClock) {
       // external clock
-      isExternalClock = true;
 
       // the pin is inverted because it is tied to an NPN transistor
       bool clockState = !gpio_get(CLOCK_IN_PIN);
@@ -124,11 +134,9 @@ struct PMDInstrument {
           // divider/multiplier is set to anyway)
 
           externalClockTicks++;
+          tickFrequencyChanged = true;
         }
       }
-    } else {
-      // internal clock
-      isExternalClock = false;
     }
 
     // either internal or external
@@ -136,136 +144,192 @@ struct PMDInstrument {
   }
 
 
+  // Runs the controller and publishes what it read as the newest state. This
+  // doesn't touch anything processBlock() uses, so it can run on another core.
   void update() {
-    controller.update(state);
+    controller.update(stateChannel.write());
+    stateChannel.publish();
   }
 
-  float process() {
-    bool tick = false;
-    if (isClockTick()) {
-      tick = true;
-
-      clockTicks++;
-      // printf("minSample: %.2f, maxSample: %.2f\n", minSample, maxSample);
-      // minSample = 0;
-      // maxSample = 0;
-
-      // Going with the teenage engineering approach of clock ticks on every
-      // second 16th note. Same as for interpreting clock inputs.
-      if (clockTicks % 2 == 0) {
-        // the pin is inverted because it is tied to an NPN transistor
-        gpio_put(CLOCK_OUT_PIN, false);
-      } else {
-        gpio_put(CLOCK_OUT_PIN, true);
-      }
+  /*
+  Renders a block of samples. The state only changes between blocks, when a new
+  snapshot gets acquired, so whatever depends on nothing but the state gets
+  worked out once per block. The envelope time also depends on the LFO value
+  sampled on the last note, so that gets recalculated on clock ticks. The LFOs
+  run at control rate (see controlTick()).
+  */
+  void processBlock(float* out, size_t count) {
+    PROFILE_SCOPE("processBlock");
+    if (stateChannel.acquire()) {
+      state = stateChannel.read();
     }
 
     lfoEnvelope.setFreq(state.envelopeLFORate.getScaled());
     lfoTembre.setFreq(state.tembreLFORate.getScaled());
 
-    // TODO: sample and hold a random value on each tick to use as
-    // modulation for that value, but have that random sequence reset (and
-    // scrable) with the other ones. Then we can modulate up to 4 things.
-    float lfoEnvelopeValue = lfoEnvelope.process();
-
-    if (tick) {
-      if (sequencer.getCurrentStep() == 0) {
-        if (randomProb() < state.scramble.getScaled()) {
-          printf("scramble!\n");
-          sequencer.setCVSeed(sequencer.getCVSeed() + 1);
-          sequencer.setCVPaletteSeed(sequencer.getCVPaletteSeed() + 1);
+    float tembreLFODepth = state.tembreLFODepth.getScaled();
+    float modulatorDepth = state.modulatorDepth.getScaled();
+    float volume = state.volume.getScaled();
+
+    isExternalClock = gpio_get(CLOCK_IN_CONNECTED_PIN);
+
+    bool envelopeChanged = true;
+
+    for (size_t i = 0; i < count; i++) {
+      bool tick = false;
+      if (isClockTick()) {
+        tick = true;
+
+        clockTicks++;
+        // printf("minSample: %.2f, maxSample: %.2f\n", minSample, maxSample);
+        // minSample = 0;
+        // maxSample = 0;
+
+        // Going with the teenage engineering approach of clock ticks on every
+        // second 16th note. Same as for interpreting clock inputs.
+        if (clockTicks % 2 == 0) {
+          // the pin is inverted because it is tied to an NPN transistor
+          gpio_put(CLOCK_OUT_PIN, false);
+        } else {
+          gpio_put(CLOCK_OUT_PIN, true);
         }
       }
-      //printf("%.2f\n", smoothResult.value);
 
-      // TODO: make these parameters "sticky" so they only update when changed
-      // enough. To prevent oscillation.
-      // TODO: only set these if the values changed
-      sequencer.setSequenceLength(state.length.getScaled());
-      sequencer.setComplexity(state.complexity.getScaled());
-      sequencer.setDensity(state.density.getScaled());
-      sequencer.setSpread(state.spread.getScaled());
-      sequencer.setBias(state.bias.getScaled());
+      if (controlClock.process()) {
+        controlTick(modulatorDepth, tembreLFODepth);
+      }
 
-      printf("length: %d, complexity: %d, bias: %.2f, density: %.2f, spread: %.2f, envLFO: %.2f, tembreLFO: %.2f\n",
-             sequencer.getSequenceLength(),
-             sequencer.getComplexity(),
-             sequencer.getBias(),
-             sequencer.getDensity(),
-             sequencer.getSpread(),
-             state.envelopeLFORate.getScaled(),
-             state.tembreLFORate.getScaled()
-            );
+      if (tick) {
+        processTick(lfoEnvelopeValue);
+        envelopeChanged = true;
+      }
 
-      auto [gate, cv] = sequencer.process();
+      if (envelopeChanged) {
+        envelopeChanged = false;
+        // use the envelope LFO value from from the last tick so the note plays as long as expected
+        float envelopeValue = monopolar(envelopeValueSample) * state.envelopeLFODepth.getScaled();
+        float decay = fclamp(state.decay.getScaled() + envelopeValue, 0.f, 1.f);
+        envelope.setTimeAndDirection(1.f - decay);
+      }
 
-      if (gate) {
-        started = true;
+      float depth = depthRamp.process();
+      for (int j = 0; j < 3; j++) {
+        pm2[j].setDepth(depth);
+      }
 
-        envelopeValueSample = lfoEnvelopeValue;
+      if (i == 0 || tickFrequencyChanged) {
+        clock.setFreq(getTickFrequency());
+      }
 
-        // TODO: also do this stuff on the first sample after reset
+      // printf("%.2f, %.2f, %.2f, %.2f\n", state.volume.getScaled(), state.carrierFreq.getScaled(),
+      // ratio, state.modulatorDepth.getScaled());
 
-        int scale = SCALE_HARMONIC_MINOR;
-        float note = 76.f * state.baseFreq.getScaled();
-        float range = state.range.getScaled() * (cv - 0.5f);
-        int *scaleNotes;
-        int numScaleNotes = getScaleNotesForScale(scale, &scaleNotes);
-        int scaleOffset = getScaleOffsetForNote(range, numScaleNotes);
-        int semitones = (int) getSemitoneOffsetForNote(scale, range);
-        float baseFrequency = addSemitonesToFrequency(getFrequencyForNote(scale, note), semitones);
-        int degree = getChordScaleDegreeForNote(scale, range);
-        int type = getChordTypeForNote(scale, degree);
-        int *offsets = getChordOffsetsForType(type);
+      float sample = 0.f;
+      if (started)  {
+        float envelopeValue = envelope.process();
+        for (int j = 0; j < 3; j++) {
+          sample += (pm2[j].process() * envelopeValue);
+        }
+      }
 
+      // TODO: non-linear volume
+      // TODO: pull out master volume into its own library so we can reuse it and
+      // always be sure it will work
+      out[i] = softClip(sample * volume);
+    }
+  }
 
-        pm2[0].setFrequency(baseFrequency);
-        pm2[0].setRatio(1.f);
+  // the control rate parameters (see control.hpp)
+  struct ControlTargets {
+    float modulatorDepth;
+  };
 
-        pm2[1].setFrequency(addSemitonesToFrequency(baseFrequency, offsets[1]));
-        pm2[1].setRatio(1.f);
+  // Both LFOs run at control rate. The envelope LFO only gets sampled on
+  // ticks, so it doesn't need a ramp.
+  ControlTargets getControlTargets(float modulatorDepth, float tembreLFODepth) {
+    // TODO: sample and hold a random value on each tick to use as
+    // modulation for that value, but have that random sequence reset (and
+    // scrable) with the other ones. Then we can modulate up to 4 things.
+    lfoEnvelopeValue = lfoEnvelope.process();
 
-        pm2[2].setFrequency(addSemitonesToFrequency(baseFrequency, offsets[2]));
-        pm2[2].setRatio(1.f);
+    float tembreValue = monopolar(lfoTembre.process()) * tembreLFODepth;
+    return {fclamp(modulatorDepth + tembreValue, 0.f, 1.f)};
+  }
 
-        envelope.trigger();
+  void rampTo(const ControlTargets& targets) {
+    depthRamp.setTarget(targets.modulatorDepth);
+  }
 
-        for (int i = 0; i < 3; i++) {
-          pm2[i].reset();
+  void controlTick(float modulatorDepth, float tembreLFODepth) {
+    rampTo(getControlTargets(modulatorDepth, tembreLFODepth));
+  }
 
-        }
+  void processTick(float lfoEnvelopeValue) {
+    PROFILE_SCOPE("sequencer");
+    if (sequencer.getCurrentStep() == 0) {
+      if (random.nextFloat() < state.scramble.getScaled()) {
+        // printf("scramble!\n");
+        sequencer.setCVSeed(sequencer.getCVSeed() + 1);
+        sequencer.setCVPaletteSeed(sequencer.getCVPaletteSeed() + 1);
       }
     }
+    //printf("%.2f\n", smoothResult.value);
 
-    // use the envelope LFO value from from the last tick so the note plays as long as expected
-    float envelopeValue = monopolar(envelopeValueSample) * state.envelopeLFODepth.getScaled();
-    float decay = fclamp(state.decay.getScaled() + envelopeValue, 0.f, 1.f);
-    envelope.setTimeAndDirection(1.f - decay);
+    // TODO: make these parameters "sticky" so they only update when changed
+    // enough. To prevent oscillation.
+    // (the sequencer only regenerates what changed, on process())
+    sequencer.setSequenceLength(state.length.getScaled());
+    sequencer.setComplexity(state.complexity.getScaled());
+    sequencer.setDensity(state.density.getScaled());
+    sequencer.setSpread(state.spread.getScaled());
+    sequencer.setBias(state.bias.getScaled());
 
-    float tembreValue = monopolar(lfoTembre.process()) * state.tembreLFODepth.getScaled();
-    float depth = fclamp(state.modulatorDepth.getScaled() + tembreValue, 0.f, 1.f);
-    for (int i = 0; i < 3; i++) {
-      pm2[i].setDepth(depth);
-    }
+    /*
+    printf("length: %d, complexity: %d, bias: %.2f, density: %.2f, spread: %.2f, envLFO: %.2f, tembreLFO: %.2f\n",
+           sequencer.getSequenceLength(),
+           sequencer.getComplexity(),
+           sequencer.getBias(),
+           sequencer.getDensity(),
+           sequencer.getSpread(),
+           state.envelopeLFORate.getScaled(),
+           state.tembreLFORate.getScaled()
+          );
+    */
+
+    auto [gate, cv] = sequencer.process();
+
+    if (gate) {
+      started = true;
+
+      envelopeValueSample = lfoEnvelopeValue;
+
+      // TODO: also do this stuff on the first sample after reset
 
+      int scale = SCALE_HARMONIC_MINOR;
+      float note = 76.f * state.baseFreq.getScaled();
+      float range = state.range.getScaled() * (cv - 0.5f);
+      // the semitones, the degree and its chord, all in one go
+      const QuantizedNote& quantized = quantizeAmount(scale, range);
+      float baseFrequency = addSemitonesToFrequency(getFrequencyForNote(scale, note), quantized.semitones);
+      const int8_t *offsets = getChordOffsetsForType(quantized.chord);
 
-    clock.setFreq(getTickFrequency());
 
-    // printf("%.2f, %.2f, %.2f, %.2f\n", state.volume.getScaled(), state.carrierFreq.getScaled(),
-    // ratio, state.modulatorDepth.getScaled());
+      pm2[0].setFrequency(baseFrequency);
+      pm2[0].setRatio(1.f);
+
+      pm2[1].setFrequency(addSemitonesToFrequency(baseFrequency, offsets[1]));
+      pm2[1].setRatio(1.f);
+
+      pm2[2].setFrequency(addSemitonesToFrequency(baseFrequency, offsets[2]));
+      pm2[2].setRatio(1.f);
+
+      envelope.trigger();
 
-    float sample = 0.f;
-    if (started)  {
-      float envelopeValue = envelope.process();
       for (int i = 0; i < 3; i++) {
-        sample += (pm2[i].process() * envelopeValue);
+        pm2[i].reset();
+
       }
     }
-
-    // TODO: non-linear volume
-    // TODO: pull out master volume into its own library so we can reuse it and
-    // always be sure it will work
-    return softClip(sample * state.volume.getScaled());
   }
 
   PMDState* getState() {
@@ -275,6 +339,8 @@ struct PMDInstrument {
   private:
   float sampleRate;
   bool isExternalClock;
+  // whether the last isClockTick() changed what getTickFrequency() returns
+  bool tickFrequencyChanged;
   int externalClockTicks;
   int clockTicks;
   int samplesSinceLastClockTick;
@@ -284,13 +350,19 @@ struct PMDInstrument {
 
   ButtonInput& bootButton;
   PMDState state;
+  StateChannel<PMDState> stateChannel;
   PMDController controller;
   PM2 pm2[3];
   Metro clock;
+  ControlClock controlClock;
+  LinearRamp depthRamp;
   AttackOrDecayEnvelope envelope;
   Sequencer sequencer;
+  Random random;
   Oscillator lfoTembre;
   Oscillator lfoEnvelope;
+  // the envelope LFO's value as of the last control tick
+  float lfoEnvelopeValue;
   float envelopeValueSample;
 };
 
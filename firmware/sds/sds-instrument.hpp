@@ -3,20 +3,25 @@
 
 #include "../../lib/buttons.hpp"
 #include "../../lib/attackordecay.hpp"
+#include "../../lib/control.hpp"
 #include "../../lib/gpio.hpp"
 #include "../../lib/ladder.hpp"
 #include "../../lib/metro.hpp"
-#include "../../lib/oscillator.hpp"
+#include "../../lib/wavetable.hpp"
 #include "../../lib/pots.hpp"
+#include "../../lib/profile.hpp"
 #include "../../lib/utils.hpp"
 #include "../../lib/quantize.hpp"
+#include "../../lib/random.hpp"
+#include "../../lib/statechannel.hpp"
 #include "sds-controller.hpp"
 #include "sds-state.hpp"
 
 #include <algorithm>
 #include <functional>
 #include <math.h>
-#include <random>
+
+#include "pico/rand.h"
 
 
 // This is kinda a balance - I don't want too many algorithms because the
@@ -41,6 +46,12 @@
 
 namespace platform {
 
+// How much the filter oversamples. 4x lets the cutoff go up to 0.425 of the
+// sample rate, 2x costs about half as much but limits the cutoff to half that.
+#ifndef SDS_FILTER_OVERSAMPLING
+#define SDS_FILTER_OVERSAMPLING 4
+#endif
+
 float maybeAttackDecay(float env, float value) {
   // close to the center means sustain
   // TODO: we should probably subtract this when calculating the ends of the envelope in attackdecay
@@ -56,6 +67,7 @@ struct SDSInstrument {
     : controller{pots},
       bootButton{bootButton},
       isExternalClock{false},
+      tickFrequencyChanged{false},
       externalClockTicks{0},
       clockTicks{0},
       samplesSinceLastClockTick{0},
@@ -77,19 +89,30 @@ struct SDSInstrument {
     sampleRate = sampleRateIn;
     oscillator.init(sampleRate);
     oscillator.setAmp(1.f);
-    oscillator.setWaveform(Oscillator::WAVE_POLYBLEP_SAW);
+    oscillator.setWaveform(WavetableOscillator::WAVE_POLYBLEP_SAW);
     clock.init(getTickFrequency(), sampleRate);
 
     volumeEnvelope.init(sampleRate);
-    cutoffEnvelope.init(sampleRate);
+    // the cutoff envelope only moves the filter, so it runs at control rate
+    cutoffEnvelope.init(controlRate(sampleRate));
 
     filter.init(sampleRate);
+    // why 0.35? because I just measured the likely min/max value. Just applying
+    // this so that overdrive doesn't increase the volume too much.
+    overdrive.init(0.35f);
 
+    // separate streams, so how much noise there is doesn't change the sequence
+    uint32_t seed = get_rand_32();
+    sequenceRandom.seed(seed, 0);
+    noiseRandom.seed(seed, 1);
     randomizeSequence();
   }
 
+  // Runs the controller and publishes what it read as the newest state. This
+  // doesn't touch anything processBlock() uses, so it can run on another core.
   void update() {
-    controller.update(state);
+    controller.update(stateChannel.write());
+    stateChannel.publish();
   }
 
   float getTickFrequency() {
@@ -142,7 +165,7 @@ struct SDSInstrument {
     that you can't end up in a spot where it drifts back and forth over a
     step's value. But that could also be a feature.
     */
-    return state.steps[state.step] >= state.skips.getScaled();
+    return sequence.steps[sequence.step] >= state.skips.getScaled();
   }
 
   float getVolume() {
@@ -164,6 +187,9 @@ struct SDSInstrument {
     // only when we get to a played step
     playedPitchChanged = scale ? playedPitchChanged : true;
 
+    // The raw pitch value can drift very slightly and then quantize to an
+    // adjacent pitch on different samples within the same step. So when we're
+    // in a step we cache the raw pitch value until the next played step.
     float rawValue = playedPitchChanged || !scale || !cachedRawBasePitch ? state.basePitch.getScaled() : cachedRawBasePitch;
     cachedRawBasePitch = rawValue;
 
@@ -254,14 +280,10 @@ struct SDSInstrument {
   }
 
   void sortByAlgorithm() {
-    // TODO: we can probably move this
-    std::random_device rd;
-    std::mt19937 g(rd());
-
     // get back to the original random order
     // (we could also just shuffle again?)
     for (int i = 0; i < 32; i++) {
-      state.pitchAmounts[i] = state.pitchAmountsBackup[i];
+      sequence.pitchAmounts[i] = sequence.pitchAmountsBackup[i];
     }
 
     switch (state.algorithm.getScaled()) {
@@ -271,155 +293,155 @@ struct SDSInstrument {
       /*
       case ALGORITHM_RAMP_UP: {
         // ramp up
-        std::sort(std::begin(state.pitchAmounts), std::end(state.pitchAmounts));
+        std::sort(std::begin(sequence.pitchAmounts), std::end(sequence.pitchAmounts));
         break;
       }
 
       case ALGORITHM_RAMP_DOWN: {
         // ramp down
-        std::sort(std::begin(state.pitchAmounts), std::end(state.pitchAmounts), std::greater<float>{});
+        std::sort(std::begin(sequence.pitchAmounts), std::end(sequence.pitchAmounts), std::greater<float>{});
         break;
       }
       */
 
       case ALGORITHM_TRIANGLE_UP: {
         // triangle up
-        std::partial_sort(std::begin(state.pitchAmounts),
-                          std::begin(state.pitchAmounts) + 16,
-                          std::begin(state.pitchAmounts) + 16,
+        std::partial_sort(std::begin(sequence.pitchAmounts),
+                          std::begin(sequence.pitchAmounts) + 16,
+                          std::begin(sequence.pitchAmounts) + 16,
                           std::less<float>{});
-        std::partial_sort(std::begin(state.pitchAmounts) + 16,
-                          std::end(state.pitchAmounts),
-                          std::end(state.pitchAmounts),
+        std::partial_sort(std::begin(sequence.pitchAmounts) + 16,
+                          std::end(sequence.pitchAmounts),
+                          std::end(sequence.pitchAmounts),
                           std::greater<float>{});
         break;
       }
 
       case ALGORITHM_TRIANGLE_DOWN: {
         // triangle down
-        std::partial_sort(std::begin(state.pitchAmounts),
-                          std::begin(state.pitchAmounts) + 16,
-                          std::begin(state.pitchAmounts) + 16,
+        std::partial_sort(std::begin(sequence.pitchAmounts),
+                          std::begin(sequence.pitchAmounts) + 16,
+                          std::begin(sequence.pitchAmounts) + 16,
                           std::greater<float>{});
-        std::partial_sort(std::begin(state.pitchAmounts) + 16,
-                          std::end(state.pitchAmounts),
-                          std::end(state.pitchAmounts),
+        std::partial_sort(std::begin(sequence.pitchAmounts) + 16,
+                          std::end(sequence.pitchAmounts),
+                          std::end(sequence.pitchAmounts),
                           std::less<float>{});
         break;
       }
 
       case ALGORITHM_TWO_TRIANGLES_UP: {
         // two triangles up
-        std::partial_sort(std::begin(state.pitchAmounts),
-                          std::begin(state.pitchAmounts) + 8,
-                          std::begin(state.pitchAmounts) + 8,
+        std::partial_sort(std::begin(sequence.pitchAmounts),
+                          std::begin(sequence.pitchAmounts) + 8,
+                          std::begin(sequence.pitchAmounts) + 8,
                           std::less<float>{});
-        std::partial_sort(std::begin(state.pitchAmounts) + 8,
-                          std::begin(state.pitchAmounts) + 16,
-                          std::begin(state.pitchAmounts) + 16,
+        std::partial_sort(std::begin(sequence.pitchAmounts) + 8,
+                          std::begin(sequence.pitchAmounts) + 16,
+                          std::begin(sequence.pitchAmounts) + 16,
                           std::greater<float>{});
-        std::partial_sort(std::begin(state.pitchAmounts) + 16,
-                          std::begin(state.pitchAmounts) + 24,
-                          std::begin(state.pitchAmounts) + 24,
+        std::partial_sort(std::begin(sequence.pitchAmounts) + 16,
+                          std::begin(sequence.pitchAmounts) + 24,
+                          std::begin(sequence.pitchAmounts) + 24,
                           std::less<float>{});
-        std::partial_sort(std::begin(state.pitchAmounts) + 24,
-                          std::end(state.pitchAmounts),
-                          std::end(state.pitchAmounts),
+        std::partial_sort(std::begin(sequence.pitchAmounts) + 24,
+                          std::end(sequence.pitchAmounts),
+                          std::end(sequence.pitchAmounts),
                           std::greater<float>{});
         break;
       }
 
       case ALGORITHM_TWO_TRIANGLES_DOWN: {
         // two triangles down
-        std::partial_sort(std::begin(state.pitchAmounts),
-                          std::begin(state.pitchAmounts) + 8,
-                          std::begin(state.pitchAmounts) + 8,
+        std::partial_sort(std::begin(sequence.pitchAmounts),
+                          std::begin(sequence.pitchAmounts) + 8,
+                          std::begin(sequence.pitchAmounts) + 8,
                           std::greater<float>{});
-        std::partial_sort(std::begin(state.pitchAmounts) + 8,
-                          std::begin(state.pitchAmounts) + 16,
-                          std::begin(state.pitchAmounts) + 16,
+        std::partial_sort(std::begin(sequence.pitchAmounts) + 8,
+                          std::begin(sequence.pitchAmounts) + 16,
+                          std::begin(sequence.pitchAmounts) + 16,
                           std::less<float>{});
-        std::partial_sort(std::begin(state.pitchAmounts) + 16,
-                          std::begin(state.pitchAmounts) + 24,
-                          std::begin(state.pitchAmounts) + 24,
+        std::partial_sort(std::begin(sequence.pitchAmounts) + 16,
+                          std::begin(sequence.pitchAmounts) + 24,
+                          std::begin(sequence.pitchAmounts) + 24,
                           std::greater<float>{});
-        std::partial_sort(std::begin(state.pitchAmounts) + 24,
-                          std::end(state.pitchAmounts),
-                          std::end(state.pitchAmounts),
+        std::partial_sort(std::begin(sequence.pitchAmounts) + 24,
+                          std::end(sequence.pitchAmounts),
+                          std::end(sequence.pitchAmounts),
                           std::less<float>{});
         break;
       }
 
       case ALGORITHM_FOUR_TRIANGLES_UP: {
         // four triangles up
-        std::partial_sort(std::begin(state.pitchAmounts),
-                          std::begin(state.pitchAmounts) + 4,
-                          std::begin(state.pitchAmounts) + 4,
+        std::partial_sort(std::begin(sequence.pitchAmounts),
+                          std::begin(sequence.pitchAmounts) + 4,
+                          std::begin(sequence.pitchAmounts) + 4,
                           std::less<float>{});
-        std::partial_sort(std::begin(state.pitchAmounts) + 4,
-                          std::begin(state.pitchAmounts) + 8,
-                          std::begin(state.pitchAmounts) + 8,
+        std::partial_sort(std::begin(sequence.pitchAmounts) + 4,
+                          std::begin(sequence.pitchAmounts) + 8,
+                          std::begin(sequence.pitchAmounts) + 8,
                           std::greater<float>{});
-        std::partial_sort(std::begin(state.pitchAmounts) + 8,
-                          std::begin(state.pitchAmounts) + 12,
-                          std::begin(state.pitchAmounts) + 12,
+        std::partial_sort(std::begin(sequence.pitchAmounts) + 8,
+                          std::begin(sequence.pitchAmounts) + 12,
+                          std::begin(sequence.pitchAmounts) + 12,
                           std::less<float>{});
-        std::partial_sort(std::begin(state.pitchAmounts) + 12,
-                          std::begin(state.pitchAmounts) + 16,
-                          std::begin(state.pitchAmounts) + 16,
+        std::partial_sort(std::begin(sequence.pitchAmounts) + 12,
+                          std::begin(sequence.pitchAmounts) + 16,
+                          std::begin(sequence.pitchAmounts) + 16,
                           std::greater<float>{});
-        std::partial_sort(std::begin(state.pitchAmounts) + 16,
-                          std::begin(state.pitchAmounts) + 20,
-                          std::begin(state.pitchAmounts) + 20,
+        std::partial_sort(std::begin(sequence.pitchAmounts) + 16,
+                          std::begin(sequence.pitchAmounts) + 20,
+                          std::begin(sequence.pitchAmounts) + 20,
                           std::less<float>{});
-        std::partial_sort(std::begin(state.pitchAmounts) + 20,
-                          std::begin(state.pitchAmounts) + 24,
-                          std::begin(state.pitchAmounts) + 24,
+        std::partial_sort(std::begin(sequence.pitchAmounts) + 20,
+                          std::begin(sequence.pitchAmounts) + 24,
+                          std::begin(sequence.pitchAmounts) + 24,
                           std::greater<float>{});
-        std::partial_sort(std::begin(state.pitchAmounts) + 24,
-                          std::begin(state.pitchAmounts) + 28,
-                          std::begin(state.pitchAmounts) + 28,
+        std::partial_sort(std::begin(sequence.pitchAmounts) + 24,
+                          std::begin(sequence.pitchAmounts) + 28,
+                          std::begin(sequence.pitchAmounts) + 28,
                           std::less<float>{});
-        std::partial_sort(std::begin(state.pitchAmounts) + 28,
-                          std::end(state.pitchAmounts),
-                          std::end(state.pitchAmounts),
+        std::partial_sort(std::begin(sequence.pitchAmounts) + 28,
+                          std::end(sequence.pitchAmounts),
+                          std::end(sequence.pitchAmounts),
                           std::greater<float>{});
         break;
       }
 
       case ALGORITHM_FOUR_TRIANGLES_DOWN: {
         // four triangles down
-        std::partial_sort(std::begin(state.pitchAmounts),
-                          std::begin(state.pitchAmounts) + 4,
-                          std::begin(state.pitchAmounts) + 4,
+        std::partial_sort(std::begin(sequence.pitchAmounts),
+                          std::begin(sequence.pitchAmounts) + 4,
+                          std::begin(sequence.pitchAmounts) + 4,
                           std::greater<float>{});
-        std::partial_sort(std::begin(state.pitchAmounts) + 4,
-                          std::begin(state.pitchAmounts) + 8,
-                          std::begin(state.pitchAmounts) + 8,
+        std::partial_sort(std::begin(sequence.pitchAmounts) + 4,
+                          std::begin(sequence.pitchAmounts) + 8,
+                          std::begin(sequence.pitchAmounts) + 8,
                           std::less<float>{});
-        std::partial_sort(std::begin(state.pitchAmounts) + 8,
-                          std::begin(state.pitchAmounts) + 12,
-                          std::begin(state.pitchAmounts) + 12,
+        std::partial_sort(std::begin(sequence.pitchAmounts) + 8,
+                          std::begin(sequence.pitchAmounts) + 12,
+                          std::begin(sequence.pitchAmounts) + 12,
                           std::greater<float>{});
-        std::partial_sort(std::begin(state.pitchAmounts) + 12,
-                          std::begin(state.pitchAmounts) + 16,
-                          std::begin(state.pitchAmounts) + 16,
+        std::partial_sort(std::begin(sequence.pitchAmounts) + 12,
+                          std::begin(sequence.pitchAmounts) + 16,
+                          std::begin(sequence.pitchAmounts) + 16,
                           std::less<float>{});
-        std::partial_sort(std::begin(state.pitchAmounts) + 16,
-                          std::begin(state.pitchAmounts) + 20,
-                          std::begin(state.pitchAmounts) + 20,
+        std::partial_sort(std::begin(sequence.pitchAmounts) + 16,
+                          std::begin(sequence.pitchAmounts) + 20,
+                          std::begin(sequence.pitchAmounts) + 20,
                           std::greater<float>{});
-        std::partial_sort(std::begin(state.pitchAmounts) + 20,
-                          std::begin(state.pitchAmounts) + 24,
-                          std::begin(state.pitchAmounts) + 24,
+        std::partial_sort(std::begin(sequence.pitchAmounts) + 20,
+                          std::begin(sequence.pitchAmounts) + 24,
+                          std::begin(sequence.pitchAmounts) + 24,
                           std::less<float>{});
-        std::partial_sort(std::begin(state.pitchAmounts) + 24,
-                          std::begin(state.pitchAmounts) + 28,
-                          std::begin(state.pitchAmounts) + 28,
+        std::partial_sort(std::begin(sequence.pitchAmounts) + 24,
+                          std::begin(sequence.pitchAmounts) + 28,
+                          std::begin(sequence.pitchAmounts) + 28,
                           std::greater<float>{});
-        std::partial_sort(std::begin(state.pitchAmounts) + 28,
-                          std::end(state.pitchAmounts),
-                          std::end(state.pitchAmounts),
+        std::partial_sort(std::begin(sequence.pitchAmounts) + 28,
+                          std::end(sequence.pitchAmounts),
+                          std::end(sequence.pitchAmounts),
                           std::less<float>{});
         break;
       }
@@ -429,14 +451,14 @@ struct SDSInstrument {
         // ramp up down
         float sorted[32];
         std::copy(
-          std::begin(state.pitchAmountsBackup), std::end(state.pitchAmountsBackup), std::begin(sorted));
+          std::begin(sequence.pitchAmountsBackup), std::end(sequence.pitchAmountsBackup), std::begin(sorted));
         std::sort(std::begin(sorted), std::end(sorted), std::less<float>{});
 
         for (int i = 0; i < 32; i++) {
           if (i % 2 == 0) {
-            state.pitchAmounts[i] = sorted[i / 2];
+            sequence.pitchAmounts[i] = sorted[i / 2];
           } else {
-            state.pitchAmounts[i] = sorted[16 + (i / 2)];
+            sequence.pitchAmounts[i] = sorted[16 + (i / 2)];
           }
         }
         break;
@@ -447,14 +469,14 @@ struct SDSInstrument {
         // ramp down up
         float sorted[32];
         std::copy(
-          std::begin(state.pitchAmountsBackup), std::end(state.pitchAmountsBackup), std::begin(sorted));
+          std::begin(sequence.pitchAmountsBackup), std::end(sequence.pitchAmountsBackup), std::begin(sorted));
         std::sort(std::begin(sorted), std::end(sorted), std::greater<float>{});
 
         for (int i = 0; i < 32; i++) {
           if (i % 2 == 0) {
-            state.pitchAmounts[i] = sorted[i / 2];
+            sequence.pitchAmounts[i] = sorted[i / 2];
           } else {
-            state.pitchAmounts[i] = sorted[16 + (i / 2)];
+            sequence.pitchAmounts[i] = sorted[16 + (i / 2)];
           }
         }
         break;
@@ -465,7 +487,7 @@ struct SDSInstrument {
         // triangle up down
         float sorted[32];
         std::copy(
-          std::begin(state.pitchAmountsBackup), std::end(state.pitchAmountsBackup), std::begin(sorted));
+          std::begin(sequence.pitchAmountsBackup), std::end(sequence.pitchAmountsBackup), std::begin(sorted));
 
         std::partial_sort(std::begin(sorted),
                           std::begin(sorted) + 16,
@@ -478,9 +500,9 @@ struct SDSInstrument {
 
         for (int i = 0; i < 32; i++) {
           if (i % 2 == 0) {
-            state.pitchAmounts[i] = sorted[i / 2];
+            sequence.pitchAmounts[i] = sorted[i / 2];
           } else {
-            state.pitchAmounts[i] = sorted[16 + (i / 2)];
+            sequence.pitchAmounts[i] = sorted[16 + (i / 2)];
           }
         }
         break;
@@ -491,7 +513,7 @@ struct SDSInstrument {
         // triangle down up
         float sorted[32];
         std::copy(
-          std::begin(state.pitchAmountsBackup), std::end(state.pitchAmountsBackup), std::begin(sorted));
+          std::begin(sequence.pitchAmountsBackup), std::end(sequence.pitchAmountsBackup), std::begin(sorted));
 
         std::partial_sort(std::begin(sorted),
                           std::begin(sorted) + 16,
@@ -504,9 +526,9 @@ struct SDSInstrument {
 
         for (int i = 0; i < 32; i++) {
           if (i % 2 == 0) {
-            state.pitchAmounts[i] = sorted[i / 2];
+            sequence.pitchAmounts[i] = sorted[i / 2];
           } else {
-            state.pitchAmounts[i] = sorted[16 + (i / 2)];
+            sequence.pitchAmounts[i] = sorted[16 + (i / 2)];
           }
         }
         break;
@@ -517,47 +539,29 @@ struct SDSInstrument {
   void randomizeSequence() {
     // randomize the whole sequence
     for (int i = 0; i < 32; i++) {
-      state.steps[i] = randomProb();
-      state.pitchAmounts[i] = randomProb();
-      state.pitchAmountsBackup[i] = state.pitchAmounts[i];
-      state.filterAmounts[i] = randomProb();
+      sequence.steps[i] = sequenceRandom.nextFloat();
+      sequence.pitchAmounts[i] = sequenceRandom.nextFloat();
+      sequence.pitchAmountsBackup[i] = sequence.pitchAmounts[i];
+      sequence.filterAmounts[i] = sequenceRandom.nextFloat();
     }
 
     if (state.stepCount.getScaled() != 0) {
       // always play the down beat, otherwise when you shorten stepCount a sequence might sound off
-      state.steps[0] = 1.f;
+      sequence.steps[0] = 1.f;
     }
 
     sortByAlgorithm();
   }
 
-  float processOverdrive(float sample, float amount, float volume) {
-    float level = 1.f - volume;
-    if (level == 0) {
-      return sample;
-    }
-
-    float in = softClip(sample / level);
-
-    // times 2 is arbitrary
-    float out = powf(fabs(in), 1.f/(1.f+amount*2.f)); 
-    if (in < 0.f) {
-      out = -out;
-    }
-
-    out = out * level;
-    return out;
-  }
-
   bool isClockTick() {
+    PROFILE_SCOPE("clock");
     samplesSinceLastClockTick++;
 
     bool tick = false;
+    tickFrequencyChanged = false;
 
-    bool clockConnectedState = gpio_get(CLOCK_IN_CONNECTED_PIN);
-    if (clockConnectedState) {
+    if (isExternalClock) {
       // external clock
-      isExternalClock = true;
 
       // the pin is inverted because it is tied to an NPN transistor
       bool clockState = !gpio_get(CLOCK_IN_PIN);
@@ -602,18 +606,30 @@ struct SDSInstrument {
           // divider/multiplier is set to anyway)
 
           externalClockTicks++;
+          tickFrequencyChanged = true;
         }
       }
-    } else {
-      // internal clock
-      isExternalClock = false;
     }
 
     // either internal or external
     return clock.process() || tick;
   }
 
-  float process() {
+  /*
+  Renders a block of samples. The state only changes between blocks, when a new
+  snapshot gets acquired, so whatever depends on nothing but the state gets
+  worked out once per block. The oscillator frequency and filter cutoff also
+  depend on the current step, so those get recalculated on clock ticks. The
+  cutoff envelope runs at control rate (see controlTick()). The block gets
+  rendered a control block at a time so the filter can process each one in one
+  go.
+  */
+  void processBlock(float* out, size_t count) {
+    PROFILE_SCOPE("processBlock");
+    if (stateChannel.acquire()) {
+      state = stateChannel.read();
+    }
+
     uint stepCount = state.stepCount.getScaled();
 
     // -1 to 1
@@ -624,140 +640,191 @@ struct SDSInstrument {
     volumeEnvelope.setTimeAndDirection(volumeEnv);
     cutoffEnvelope.setTimeAndDirection(cutoffEnv);
 
-    if (isClockTick()) {
-      clockTicks++;
-      //printf("minSample: %.2f, maxSample: %.2f\n", minSample, maxSample);
-      minSample = 0;
-      maxSample = 0;
-
-      // Going with the teenage engineering approach of clock ticks on every
-      // second 16th note. Same as for interpreting clock inputs.
-      if (clockTicks % 2 == 0) {
-        // the pin is inverted because it is tied to an NPN transistor
-        gpio_put(CLOCK_OUT_PIN, false);
-      } else {
-        gpio_put(CLOCK_OUT_PIN, true);
-      }
+    filter.setRes(state.resonance.getScaled() * 1.8f);
 
-      if (stepCount == 0) {
-        randomizeSequence();
-      }
+    bool isLowPass = state.cutoff.value <= 0.f;
+    if (isLowPass) {
+      // low pass
+      filter.setFilterMode(LadderFilterMode::LP24);
+    } else {
+      // high pass
+      filter.setFilterMode(LadderFilterMode::HP24);
+    }
 
-      if (isPlayedStep()) {
-        // recalculate volume, frequency and cutoff, the steps..
-        playedPitchChanged = true;
-        lastPlayedPitchAmount = state.pitchAmounts[state.step];
-        lastPlayedFilterAmount = state.filterAmounts[state.step];
-
-        float evolve = state.evolve.value;
-        float evolveAbs = fabs(evolve);
-        // only evolve if the random probability is greater than the current
-        // absolute evolve value
-        bool evolved = false;
-        if (evolveAbs/4.f > randomProb()) {
-          evolved = true;
-          if (evolve > 0.f) {
-            state.filterAmounts[state.step] = randomProb();
-            // change the backup, because we're going to sort by algorithm
-            state.pitchAmountsBackup[state.step] = randomProb();
-          }
-          else {
-            state.steps[state.step] = randomProb();
-          }
+    float volume = getVolume();
+    overdrive.setAmount(state.drive.getScaled());
+    bool hasNoise = state.noise.value > 0.f;
+    float noise = state.noise.getScaled();
+    int noiseInterval = (int) ((1.f - noise) * 1000.f);
 
-          if (state.stepCount.getScaled() != 0) {
-            // always play the down beat, otherwise when you shorten stepCount a sequence might sound off
-            state.steps[0] = 1.f;
-          }
+    isExternalClock = gpio_get(CLOCK_IN_CONNECTED_PIN);
+
+    bool stepChanged = true;
+    float frequency = 0.f;
+    float filterCutoff = 0.f;
+
+    // the volume envelope has to run alongside the clock because ticks trigger
+    // it, but it only gets applied after the filter
+    float envelopeGains[CONTROL_BLOCK_SIZE];
+
+    for (size_t start = 0; start < count;) {
+      bool controlDue = controlClock.isDue();
+      size_t end = start + controlClock.processSpan(count - start);
+
+      for (size_t i = start; i < end; i++) {
+        if (isClockTick()) {
+          processTick(stepCount);
+          stepChanged = true;
         }
 
-        // trigger notes, advance sequencer, etc
-        int algorithm = state.algorithm.getScaled();
-        // if the algorithm has changed or the sequence evolved, resort the
-        // amounts. So all algorithms other than random keep their basic shape
-        if (algorithm != previousAlgorithm || evolved) {
-          previousAlgorithm = algorithm;
-          sortByAlgorithm();
+        if (i == 0 || tickFrequencyChanged) {
+          clock.setFreq(getTickFrequency());
         }
 
-        volumeEnvelope.trigger();
-        cutoffEnvelope.trigger();
-      } else {
-        // TODO: evolve non-played steps so they can come back to life.
-        // Otherwise if you evolve skips the sequence eventually empties.
-      }
+        if (stepChanged) {
+          stepChanged = false;
+          frequency = getOscillatorFrequency();
+          filterCutoff = getFilterCutoff();
+          oscillator.setFreq(frequency);
+        }
+
+        if (i == start && controlDue) {
+          controlTick(filterCutoff, isLowPass, cutoffEnv);
+        }
 
-      state.step++;
+        float sample = 0.f;
 
-      if (state.step >= stepCount) {
-        state.step = 0;
+        // oscillator (if not stopped)
+        if (frequency > 28.f) {
+          sample = oscillator.process(); // -0.5 to 0.5
+        }
+
+        // noise
+        if (hasNoise) {
+          noiseSteps++;
+          if (noiseSteps >= noiseInterval) {
+            noiseSteps = 0;
+            lastNoise = noiseRandom.nextBipolar() * noise;
+          } 
+          sample += lastNoise;
+        }
+
+        envelopeGains[i - start] = maybeAttackDecay(volumeEnv, volumeEnvelope.process());
+        out[i] = sample;
       }
-    }
 
+      // filter
+      filter.processBlock(out + start, end - start);
 
-    clock.setFreq(getTickFrequency());
-    filter.setRes(state.resonance.getScaled() * 1.8f);
+      for (size_t i = start; i < end; i++) {
+        float sample = overdrive.process(out[i]);
 
+        minSample = std::min(minSample, sample);
+        maxSample = std::max(maxSample, sample);
 
-    float sample = 0.f;
+        // volume
+        sample = sample * volume * envelopeGains[i - start];
 
-    // oscillator (if not stopped)
-    float frequency = getOscillatorFrequency();
-    if (frequency > 28.f) {
-      oscillator.setFreq(frequency);
-      sample = oscillator.process(); // -0.5 to 0.5
-    }
+        out[i] = softClip(sample);
+      }
 
-    // noise
-    if (state.noise.value > 0.f) {
-      noiseSteps++;
-      if (noiseSteps >= (int) ((1.f - state.noise.getScaled()) * 1000.f)) {
-        noiseSteps = 0;
-        lastNoise = (randomProb() * 2.f - 1.f) * state.noise.getScaled();
-      } 
-      sample += lastNoise;
+      start = end;
     }
+  }
 
-    // filter
-    float filterCutoff = getFilterCutoff();
+  // the control rate parameters (see control.hpp)
+  struct ControlTargets {
+    float cutoff;
+  };
+
+  // the cutoff envelope runs at control rate
+  ControlTargets getControlTargets(float filterCutoff, bool isLowPass, float cutoffEnv) {
     // when in lowpass mode, the envelope closes the filter towards 5Hz.
     // when in highpass mode, the envelope closes the filter towards HALF_SAMPLE_RATE.
-    float cutoff = state.cutoff.value <= 0.f
+    float cutoff = isLowPass
       ? filterCutoff * maybeAttackDecay(cutoffEnv, cutoffEnvelope.process())
       : filterCutoff + ((HALF_SAMPLE_RATE - filterCutoff) * (1.f - maybeAttackDecay(cutoffEnv, cutoffEnvelope.process())));
 
-    if (state.cutoff.value <= 0.f) {
-      // low pass
-      filter.setFilterMode(LadderFilter::FilterMode::LP24);
-    } else {
-      // high pass
-      filter.setFilterMode(LadderFilter::FilterMode::HP24);
+    return {fmax(5.f, cutoff)};
+  }
+
+  void rampTo(const ControlTargets& targets) {
+    filter.rampFreq(targets.cutoff);
+  }
 
+  void controlTick(float filterCutoff, bool isLowPass, float cutoffEnv) {
+    rampTo(getControlTargets(filterCutoff, isLowPass, cutoffEnv));
+  }
+
+  void processTick(uint stepCount) {
+    PROFILE_SCOPE("sequencer");
+    clockTicks++;
+    //printf("minSample: %.2f, maxSample: %.2f\n", minSample, maxSample);
+    minSample = 0;
+    maxSample = 0;
+
+    // Going with the teenage engineering approach of clock ticks on every
+    // second 16th note. Same as for interpreting clock inputs.
+    if (clockTicks % 2 == 0) {
+      // the pin is inverted because it is tied to an NPN transistor
+      gpio_put(CLOCK_OUT_PIN, false);
+    } else {
+      gpio_put(CLOCK_OUT_PIN, true);
     }
-    filter.setFreq(fmax(5.f, cutoff));
-    sample = filter.process(sample);
 
+    if (stepCount == 0) {
+      randomizeSequence();
+    }
 
-    // overdrive
-    // why 0.35? because I just measured the likely min/max value. Just applying
-    // this so that overdrive doesn't increase the volume too much.
-    sample = processOverdrive(sample, state.drive.getScaled(), 0.35f);
+    if (isPlayedStep()) {
+      // recalculate volume, frequency and cutoff, the steps..
+      playedPitchChanged = true;
+      lastPlayedPitchAmount = sequence.pitchAmounts[sequence.step];
+      lastPlayedFilterAmount = sequence.filterAmounts[sequence.step];
+
+      float evolve = state.evolve.value;
+      float evolveAbs = fabs(evolve);
+      // only evolve if the random probability is greater than the current
+      // absolute evolve value
+      bool evolved = false;
+      if (evolveAbs/4.f > sequenceRandom.nextFloat()) {
+        evolved = true;
+        if (evolve > 0.f) {
+          sequence.filterAmounts[sequence.step] = sequenceRandom.nextFloat();
+          // change the backup, because we're going to sort by algorithm
+          sequence.pitchAmountsBackup[sequence.step] = sequenceRandom.nextFloat();
+        }
+        else {
+          sequence.steps[sequence.step] = sequenceRandom.nextFloat();
+        }
 
-    minSample = std::min(minSample, sample);
-    maxSample = std::max(maxSample, sample);
+        if (state.stepCount.getScaled() != 0) {
+          // always play the down beat, otherwise when you shorten stepCount a sequence might sound off
+          sequence.steps[0] = 1.f;
+        }
+      }
 
-    // volume
-    sample = sample * getVolume() * maybeAttackDecay(volumeEnv, volumeEnvelope.process());
+      // trigger notes, advance sequencer, etc
+      int algorithm = state.algorithm.getScaled();
+      // if the algorithm has changed or the sequence evolved, resort the
+      // amounts. So all algorithms other than random keep their basic shape
+      if (algorithm != previousAlgorithm || evolved) {
+        previousAlgorithm = algorithm;
+        sortByAlgorithm();
+      }
 
+      volumeEnvelope.trigger();
+      cutoffEnvelope.trigger();
+    } else {
+      // TODO: evolve non-played steps so they can come back to life.
+      // Otherwise if you evolve skips the sequence eventually empties.
+    }
 
-    // cache what we can until the next clock tick
-    // The raw pitch value can drift very slightly and then quantize to
-    // an adjacent pitch on different samples within the same step. So when
-    // we're in a step we cache the raw pitch value
+    sequence.step++;
 
-    sample = softClip(sample);
-    
-    return sample;
+    if (sequence.step >= stepCount) {
+      sequence.step = 0;
+    }
   }
 
   SDSState* getState() {
@@ -766,6 +833,8 @@ struct SDSInstrument {
 
   private:
   bool isExternalClock;
+  // whether the last isClockTick() changed what getTickFrequency() returns
+  bool tickFrequencyChanged;
   int externalClockTicks;
   int clockTicks;
   int samplesSinceLastClockTick;
@@ -784,12 +853,18 @@ struct SDSInstrument {
   int noiseSteps;
   ButtonInput& bootButton;
   SDSState state;
+  StateChannel<SDSState> stateChannel;
+  SDSSequence sequence;
   SDSController controller;
   Metro clock;
+  ControlClock controlClock;
   AttackOrDecayEnvelope volumeEnvelope;
   AttackOrDecayEnvelope cutoffEnvelope;
-  Oscillator oscillator;
-  LadderFilter filter;
+  WavetableOscillator oscillator;
+  Random sequenceRandom;
+  Random noiseRandom;
+  LadderFilter<SDS_FILTER_OVERSAMPLING, LadderFilterMode::LP24, LadderFilterMode::HP24> filter;
+  Overdrive overdrive;
 
   float minSample;
   float maxSample;
@@ -48,14 +48,6 @@ struct SDSState {
   ScaleParameter scale;
   RawParameter resonance;
 
-  uint step = 0;
-  std::array<float, 32> steps;  
-  // amounts are the amount of modulation for each step
-  std::array<float, 32> pitchAmounts;
-  std::array<float, 32> filterAmounts;
-  //std::array<float, 32> volumeAmounts;
-  // keep a backup so we can sort them by algorithm, yet go back to the original random order
-  std::array<float, 32> pitchAmountsBackup;  
 
   SDSState()
     : bpm{120.f},
@@ -76,9 +68,24 @@ struct SDSState {
       skips{0},
       //volumeAmount{0},
       pitchAmount{0},
-      cutoffAmount{0},
-      
-      step{0} {
+      cutoffAmount{0} {
+  }
+};
+
+// The sequence the instrument plays. This isn't part of SDSState because the
+// instrument changes it while it plays, whereas SDSState only comes from the
+// controller.
+struct SDSSequence {
+  uint step = 0;
+  std::array<float, 32> steps;  
+  // amounts are the amount of modulation for each step
+  std::array<float, 32> pitchAmounts;
+  std::array<float, 32> filterAmounts;
+  //std::array<float, 32> volumeAmounts;
+  // keep a backup so we can sort them by algorithm, yet go back to the original random order
+  std::array<float, 32> pitchAmountsBackup;  
+
+  SDSSequence() : step{0} {
     for (size_t i = 0; i < 16; i++) {
       steps[i] = 0.f;
       pitchAmounts[i] = 0.f;
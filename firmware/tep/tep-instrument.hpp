@@ -4,24 +4,42 @@
 #include "../../lib/arpeggio.hpp"
 #include "../../lib/attackordecay.hpp"
 #include "../../lib/buttons.hpp"
+#include "../../lib/control.hpp"
+#include "../../lib/fixed.hpp"
 #include "../../lib/inoutclock.hpp"
 #include "../../lib/ladder.hpp"
 #include "../../lib/metro.hpp"
-#include "../../lib/oscillator.hpp"
+#include "../../lib/oscillatorbank.hpp"
 #include "../../lib/pots.hpp"
+#include "../../lib/profile.hpp"
 #include "../../lib/quantize.hpp"
 #include "../../lib/rhythms.hpp"
+#include "../../lib/statechannel.hpp"
 #include "../../lib/utils.hpp"
+#include "../../lib/wavetable.hpp"
 #include "tep-controller.hpp"
 #include "tep-state.hpp"
 
 #include <algorithm>
 #include <functional>
 #include <math.h>
-#include <random>
+
+#include "pico/rand.h"
 
 namespace platform {
 
+// How much the filter oversamples. 4x lets the cutoff go up to 0.425 of the
+// sample rate, 2x costs about half as much but limits the cutoff to half that.
+#ifndef TEP_FILTER_OVERSAMPLING
+#define TEP_FILTER_OVERSAMPLING 4
+#endif
+
+// 1 runs the oscillators, filter, overdrive and VCA in fixed point (see
+// lib/fixed.hpp) instead of float, for cores without an FPU.
+#ifndef TEP_FIXED_POINT
+#define TEP_FIXED_POINT 0
+#endif
+
 void printRhythm(std::vector<bool>* rhythm) {
   printf("[");
   for (int i = 0; i < rhythm->size(); i++) {
@@ -31,24 +49,6 @@ void printRhythm(std::vector<bool>* rhythm) {
   printf("] ");
 }
 
-float processOverdrive(float sample, float amount, float volume) {
-  float level = 1.f - volume;
-  if (level == 0) {
-    return sample;
-  }
-
-  float in = softClip(sample / level);
-
-  // times 2 is arbitrary
-  float out = powf(fabs(in), 1.f / (1.f + amount * 2.f));
-  if (in < 0.f) {
-    out = -out;
-  }
-
-  out = out * level;
-  return out;
-}
-
 float lerpByPhase(float a, float b, float amount, float phase) {
   if (phase >= amount) {
     return b;
@@ -60,18 +60,25 @@ float lerpByPhase(float a, float b, float amount, float phase) {
 
 // Two-tone Euclidean Polymeters
 struct TEPInstrument {
+#if TEP_FIXED_POINT
+  using Sample = q27;
+#else
+  using Sample = float;
+#endif
+
   TEPInstrument(Pots& pots, ButtonInput& bootButton)
     : controller{pots},
       bootButton{bootButton},
       started{false},
-      minSample{0.f},
-      maxSample{0.f},
+      minSample{0},
+      maxSample{0},
       previousOscillatorFrequency{0.f},
       previousCutoff{0.f},
       previousVolume{0.f},
       nextOscillatorFrequency{0.f},
       nextCutoff{0.f},
       nextVolume{0.f},
+      isControlTickPending{false},
       lastChordIndex{0},
       lastArpeggioMode{0} {};
 
@@ -79,18 +86,18 @@ struct TEPInstrument {
     printf("init\n");
     sampleRate = sampleRateIn;
 
-    oscillator1.init(sampleRate);
-    oscillator1.setAmp(1.0f);
-    oscillator1.setWaveform(Oscillator::WAVE_POLYBLEP_SAW);
-    oscillator2.init(sampleRate);
-    oscillator2.setAmp(1.0f);
-    oscillator2.setWaveform(Oscillator::WAVE_POLYBLEP_SAW);
+    oscillators.init(sampleRate);
+    oscillators.setAmp(1.0f);
     filter.init(sampleRate);
+    // why 0.35? because I just measured the likely min/max value. Just applying
+    // this so that overdrive doesn't increase the volume too much.
+    // TODO: re-measure if it is really still 0.35 with this new firmware
+    overdrive.init(0.35f);
     inOutClock.init(sampleRate);
     // clock.init(inOutClock.getTickFrequency(state.bpm.getScaled()), sampleRate);
     clock.init(1.f, sampleRate);
+    arpeggio.seed(get_rand_32());
 
-    filter.setFilterMode(LadderFilter::FilterMode::LP24);
 
     // sort the rhythms so that the total number of true values for each divided
     // by the total number of values for each is increasing in order. So { 0 }
@@ -105,8 +112,11 @@ struct TEPInstrument {
               });
   }
 
+  // Runs the controller and publishes what it read as the newest state. This
+  // doesn't touch anything processBlock() uses, so it can run on another core.
   void update() {
-    controller.update(state);
+    controller.update(stateChannel.write());
+    stateChannel.publish();
   }
 
   float getOscillatorFrequency() {
@@ -127,7 +137,7 @@ struct TEPInstrument {
       return arpeggio.getLastValue();
     }
 
-    printf("caching chordIndex: %d, arpeggioMode: %d\n", chordIndex, (int)arpeggioMode);
+    // printf("caching chordIndex: %d, arpeggioMode: %d\n", chordIndex, (int)arpeggioMode);
     lastChordIndex = chordIndex;
     lastArpeggioMode = arpeggioMode;
 
@@ -135,29 +145,29 @@ struct TEPInstrument {
 
     // chordType is major, minor, diminished or augmented
     int chordType = getChordTypeForNote(SCALE_NATURAL_MINOR, degreeOffset);
-    int* offsets = getChordOffsetsForType(chordType);
-    std::vector<int> offsetsVec{offsets, offsets + 3};
+    const int8_t* offsets = getChordOffsetsForType(chordType);
+    int chordOffsets[4] = {offsets[0], offsets[1], offsets[2]};
 
     // add the 7th
-    // offsetsVec.push_back(naturalMinorOffsets[6]);
+    // chordOffsets[3] = scales[SCALE_NATURAL_MINOR].offsets[6];
     // add the 6th
-    offsetsVec.push_back(naturalMinorOffsets[5]);
-    std::sort(offsetsVec.begin(), offsetsVec.end());
+    chordOffsets[3] = scales[SCALE_NATURAL_MINOR].offsets[5];
+    std::sort(chordOffsets, chordOffsets + 4);
 
-    std::vector<float> arpeggioValues;
+    float arpeggioValues[4];
     for (int i = 0; i < 4; i++) {
       // noteIndex is the actual note in the chord
-      int noteIndex = chordIndex + offsetsVec[i];
+      int noteIndex = chordIndex + chordOffsets[i];
       if (noteIndex < 0) {
         noteIndex = 0;
       } else if (noteIndex > 87) {
         noteIndex = 87;
       }
       float freq = notes[noteIndex];
-      arpeggioValues.push_back(freq);
+      arpeggioValues[i] = freq;
     }
 
-    arpeggio.setValues(arpeggioValues);
+    arpeggio.setValues(arpeggioValues, 4);
 
     // return degreeRhythm.getLastValue() ? arpeggio.process() : arpeggio.getLastValue();
     return arpeggio.getLastValue();
@@ -220,94 +230,189 @@ struct TEPInstrument {
     return value;
   }
 
-  float process() {
-    clock.setFreq(getClockFrequency());
-    filter.setRes(getResonance());
+  /*
+  Renders a block of samples. The state only changes between blocks, when a new
+  snapshot gets acquired, so whatever depends on nothing but the state gets
+  worked out once per block and the targets for the next step only get
+  recalculated when the clock ticks. Gliding towards those targets happens at
+  control rate (see controlTick()). The block gets rendered a control block at
+  a time: first the clock for every sample of it, then the oscillators and the
+  filter each in one go.
+  */
+  void processBlock(float* out, size_t count) {
+    PROFILE_SCOPE("processBlock");
+    if (stateChannel.acquire()) {
+      state = stateChannel.read();
+    }
 
-    bool tick = inOutClock.process(state.bpm.getScaled());
+    float bpm = state.bpm.getScaled();
+    float glideAmount = state.glide.getScaled();
+    float detune = state.detune.getScaled();
 
-    if (tick) {
-      previousOscillatorFrequency = nextOscillatorFrequency;
-      previousCutoff = nextCutoff;
-      previousVolume = nextVolume;
+    clock.setFreq(getClockFrequency());
+    overdrive.setAmount(state.distortion.getScaled());
+    filter.setRes(getResonance());
+    inOutClock.updateConnected();
+
+    bool targetsChanged = true;
+    Sample voice[CONTROL_BLOCK_SIZE];
+
+    for (size_t start = 0; start < count;) {
+      bool controlDue = controlClock.isDue();
+      size_t end = start + controlClock.processSpan(count - start);
+      // before the first clock tick there's no note yet
+      size_t silent = 0;
+
+      for (size_t i = start; i < end; i++) {
+        bool tick = inOutClock.process(bpm);
+        if (inOutClock.isTickFrequencyChanged()) {
+          clock.setFreq(getClockFrequency());
+        }
+
+        if (tick) {
+          processTick();
+          targetsChanged = true;
+        }
+
+        bool isSilent = !inOutClock.getClockTicks();
+        if (!isSilent && targetsChanged) {
+          targetsChanged = false;
+          nextOscillatorFrequency = getOscillatorFrequency();
+          nextCutoff = getCutoff();
+          nextVolume = getVolume();
+        }
+
+        // At the start of every control block. If that's before the first
+        // note, it runs again at the first note (which can be in a later
+        // processBlock() call), now that there are targets to glide to.
+        if (i == start && controlDue) {
+          controlTick(glideAmount, detune);
+          isControlTickPending = isSilent;
+        } else if (isControlTickPending && !isSilent) {
+          controlTick(glideAmount, detune);
+          isControlTickPending = false;
+        }
+
+        if (isSilent) {
+          silent++;
+        }
+      }
 
-      if (degreeRhythm.process()) {
-        // if the next step in the rhythm is on, then advance the arpeggio.
-        // otherwise play the same note as last time. This gives the user the option
-        // to play 'stochastic' or to just sustain drones longer before changing the
-        // note.
+      // the silent samples don't go through anything, so the oscillators,
+      // filter and volume start from the first note
+      size_t sounding = end - start - silent;
+      processOscillators(voice, sounding);
+      filter.processBlock(voice, sounding);
 
-        arpeggio.process();
+      for (size_t i = start; i < start + silent; i++) {
+        out[i] = 0.f;
+      }
+      for (size_t i = start + silent; i < end; i++) {
+        out[i] = sampleToFloat(processOutput(voice[i - start - silent]));
       }
-      volumeRhythm.process();
-      cutoffRhythm.process();
-
-      // printf("minSample: %.2f, maxSample: %.2f\n", minSample, maxSample);
-      minSample = 0;
-      maxSample = 0;
-
-      std::vector<bool>* volumer = &euclideanRhythms[state.volumeRhythm.getScaled()];
-      volumeRhythm.setRhythm(volumer);
-      std::vector<bool>* cutoffr = &euclideanRhythms[state.cutoffRhythm.getScaled()];
-      cutoffRhythm.setRhythm(cutoffr);
-      std::vector<bool>* degreer = &euclideanRhythms[state.degreeRhythm.getScaled()];
-      degreeRhythm.setRhythm(degreer);
-
-      /*
-      printRhythm(volumer);
-      printRhythm(cutoffr);
-      printRhythm(degreer);
-
-      printf("arp: %d, volume: %d, cutoff: %d, degree: %d\n",
-             state.arpeggioMode.getScaled(),
-             state.volumeRhythm.getScaled(),
-             state.cutoffRhythm.getScaled(),
-             state.degreeRhythm.getScaled());
-      */
-    }
 
-    if (!inOutClock.getClockTicks()) {
-      return 0.f;
+      start = end;
     }
+  }
 
-    // update all these on every tick for now
-    nextOscillatorFrequency = getOscillatorFrequency();
-    nextCutoff = getCutoff();
-    nextVolume = getVolume();
-
-    float glideAmount = state.glide.getScaled();
+  // the control rate parameters (see control.hpp)
+  struct ControlTargets {
+    float oscillatorFrequency;  // the first oscillator
+    float detunedFrequency;     // the second one
+    float cutoff;
+    float volume;
+  };
+
+  // The oscillator frequency, cutoff and volume glide from the previous step's
+  // values to the next step's over the glide part of a tick
+  ControlTargets getControlTargets(float glideAmount, float detune) {
     float clockPhase = clock.getPhase() / TWOPI_F;
 
     // printf("glide: %.2f, phase: %.2f\n", glideAmount, clockPhase);
 
     float freq =
       lerpByPhase(previousOscillatorFrequency, nextOscillatorFrequency, glideAmount, clockPhase);
-    oscillator1.setFreq(freq);
-    oscillator2.setFreq(freq - state.detune.getScaled());  // TODO
-    float cutoff = lerpByPhase(previousCutoff, nextCutoff, glideAmount, clockPhase);
-    filter.setFreq(cutoff);
-
-    float sample = oscillator1.process();
-    sample += oscillator2.process();
-    // if (oscillator1.isEOC()) {
-    // oscillator2.reset();
-    //}
-    sample = filter.process(sample);
+    return {
+      freq,
+      freq - detune,  // TODO
+      lerpByPhase(previousCutoff, nextCutoff, glideAmount, clockPhase),
+      lerpByPhase(previousVolume, nextVolume, glideAmount, clockPhase),
+    };
+  }
+
+  void rampTo(const ControlTargets& targets) {
+    oscillators.rampFreq(0, targets.oscillatorFrequency);
+    oscillators.rampFreq(1, targets.detunedFrequency);
+    filter.rampFreq(targets.cutoff);
+    volumeRamp.setTarget(targets.volume);
+  }
+
+  void controlTick(float glideAmount, float detune) {
+    rampTo(getControlTargets(glideAmount, detune));
+  }
+
+  void processTick() {
+    PROFILE_SCOPE("sequencer");
+    previousOscillatorFrequency = nextOscillatorFrequency;
+    previousCutoff = nextCutoff;
+    previousVolume = nextVolume;
+
+    if (degreeRhythm.process()) {
+      // if the next step in the rhythm is on, then advance the arpeggio.
+      // otherwise play the same note as last time. This gives the user the option
+      // to play 'stochastic' or to just sustain drones longer before changing the
+      // note.
+
+      arpeggio.process();
+    }
+    volumeRhythm.process();
+    cutoffRhythm.process();
 
+    // printf("minSample: %.2f, maxSample: %.2f\n", minSample, maxSample);
+    minSample = 0;
+    maxSample = 0;
+
+    std::vector<bool>* volumer = &euclideanRhythms[state.volumeRhythm.getScaled()];
+    volumeRhythm.setRhythm(volumer);
+    std::vector<bool>* cutoffr = &euclideanRhythms[state.cutoffRhythm.getScaled()];
+    cutoffRhythm.setRhythm(cutoffr);
+    std::vector<bool>* degreer = &euclideanRhythms[state.degreeRhythm.getScaled()];
+    degreeRhythm.setRhythm(degreer);
+
+    /*
+    printRhythm(volumer);
+    printRhythm(cutoffr);
+    printRhythm(degreer);
+
+    printf("arp: %d, volume: %d, cutoff: %d, degree: %d\n",
+           state.arpeggioMode.getScaled(),
+           state.volumeRhythm.getScaled(),
+           state.cutoffRhythm.getScaled(),
+           state.degreeRhythm.getScaled());
+    */
+  }
+
+  // both oscillators mixed, for count samples
+  void processOscillators(Sample* out, size_t count) {
+    oscillators.process(out, count);
+  }
+
+  // everything after the filter
+  Sample processOutput(Sample sample) {
     // TODO: distortion
 
-    // overdrive
-    // why 0.35? because I just measured the likely min/max value. Just applying
-    // this so that overdrive doesn't increase the volume too much.
-    // TODO: re-measure if it is really still 0.35 with this new firmware
-    sample = processOverdrive(sample, state.distortion.getScaled(), 0.35f);
+    sample = overdrive.process(sample);
 
     minSample = std::min(minSample, sample);
     maxSample = std::max(maxSample, sample);
 
-    float volume = lerpByPhase(previousVolume, nextVolume, glideAmount, clockPhase);
-    sample *= volume;
+#if TEP_FIXED_POINT
+    sample = mulShiftSat<24>(sample, volumeRamp.process());
+    return softClipQ27(sample);
+#else
+    sample *= volumeRamp.process();
     return softClip(sample);
+#endif
   }
 
   TEPState* getState() {
@@ -316,6 +421,7 @@ struct TEPInstrument {
 
   TEPController controller;
   TEPState state;
+  StateChannel<TEPState> stateChannel;
   ButtonInput& bootButton;
 
   float sampleRate;
@@ -323,9 +429,19 @@ struct TEPInstrument {
 
   Metro clock;
   InOutClock inOutClock{clock};
-  Oscillator oscillator1;
-  Oscillator oscillator2;
-  LadderFilter filter;
+  ControlClock controlClock;
+  // the note and the detuned one
+  OscillatorBank<2, WavetableWaveform<WAVETABLE_SAW, Sample>> oscillators;
+#if TEP_FIXED_POINT
+  // Q24, the volume goes up to 81
+  FixedLinearRamp<24> volumeRamp;
+  FixedLadderFilter<TEP_FILTER_OVERSAMPLING, LadderFilterMode::LP24> filter;
+  FixedOverdrive overdrive;
+#else
+  LinearRamp volumeRamp;
+  LadderFilter<TEP_FILTER_OVERSAMPLING, LadderFilterMode::LP24> filter;
+  Overdrive overdrive;
+#endif
 
   Rhythm volumeRhythm;
   Rhythm cutoffRhythm;
@@ -333,8 +449,8 @@ struct TEPInstrument {
 
   Arpeggio arpeggio;
 
-  float minSample;
-  float maxSample;
+  Sample minSample;
+  Sample maxSample;
 
   float previousOscillatorFrequency;
   float previousCutoff;
@@ -343,6 +459,8 @@ struct TEPInstrument {
   float nextOscillatorFrequency;
   float nextCutoff;
   float nextVolume;
+  // the control block started before the first note, see processBlock()
+  bool isControlTickPending;
 
   int lastChordIndex;
   ArpeggioMode lastArpeggioMode;
@@ -0,0 +1,830 @@
+/*
+Micro-benchmarks for the DSP blocks in lib/ and for each firmware as a whole.
+
+Every benchmark is timed a few times and the fastest run is reported, as
+nanoseconds per sample (or per call for things that don't run per sample) and
+as an estimate of the cycles that would take on the target. The estimate is
+host time * target clock * --scale, where --scale is how many times slower
+than the host the target is per clock. Calibrate it against a measurement on
+the board, until then the cycle counts are only good for comparing blocks with
+each other. The budget column is the share of one sample period that would use.
+
+usage: platform16_bench [options]
+  -o <file>       write the results as json (default: stdout)
+  -n <count>      samples or calls per run (default 200000)
+  -f <filter>     only run benchmarks whose name contains this
+  --mhz <mhz>     clock speed of the target for the cycle estimate (default 150)
+  --scale <x>     how many times slower than the host the target is per clock
+                  (default 1)
+  --rate <rate>   sample rate (default 24000)
+*/
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <chrono>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "quiet.hpp"
+#include "runner.hpp"
+
+#include "../lib/arpeggio.hpp"
+#include "../lib/attackordecay.hpp"
+#include "../lib/fixed.hpp"
+#include "../lib/ladder.hpp"
+#include "../lib/oscillator.hpp"
+#include "../lib/oscillatorbank.hpp"
+#include "../lib/pm2.hpp"
+#include "../lib/quantize.hpp"
+#include "../lib/random.hpp"
+#include "../lib/resample.hpp"
+#include "../lib/saturation.hpp"
+#include "../lib/sequencer.hpp"
+#include "../lib/variablesawosc.hpp"
+#include "../lib/wavetable.hpp"
+
+using namespace platform;
+
+struct BenchOptions {
+  std::string outputPath;
+  uint iterations = 200000;
+  std::string filter;
+  float mhz = 150.f;
+  float scale = 1.f;
+  float sampleRate = 24000.f;
+};
+
+struct BenchResult {
+  std::string name;
+  const char* unit;
+  double ns;
+};
+
+BenchOptions options;
+std::vector<BenchResult> results;
+
+// somewhere for results to go so the compiler can't throw the work away
+volatile float sink;
+volatile int32_t fixedSink;
+
+const uint numRuns = 5;
+
+// makes the compiler assume that whatever is behind pointer got read and
+// changed, so work that only writes to members doesn't get optimised away
+inline void clobber(void* pointer) {
+  asm volatile("" : : "r"(pointer) : "memory");
+}
+
+double estimateCycles(double ns) {
+  return ns * options.mhz / 1000.0 * options.scale;
+}
+
+bool isSelected(const std::string& name) {
+  return options.filter.empty() || name.find(options.filter) != std::string::npos;
+}
+
+/*
+Times body(i) for i in 0..iterations and records the fastest of a few runs.
+setup() gets called before every run so each run starts from the same state.
+If every call to body() handles more than one sample or call, pass that as
+perIteration.
+*/
+template<typename Setup, typename Body>
+void bench(const std::string& name,
+           const char* unit,
+           uint iterations,
+           Setup&& setup,
+           Body&& body,
+           uint perIteration = 1) {
+  if (!isSelected(name)) {
+    return;
+  }
+
+  double best = 0.0;
+  for (uint run = 0; run < numRuns; run++) {
+    setup();
+    auto start = std::chrono::steady_clock::now();
+    for (uint i = 0; i < iterations; i++) {
+      body(i);
+    }
+    auto end = std::chrono::steady_clock::now();
+    double ns = std::chrono::duration<double, std::nano>(end - start).count() /
+      ((double)iterations * perIteration);
+    if (run == 0 || ns < best) {
+      best = ns;
+    }
+  }
+
+  results.push_back({name, unit, best});
+  double cycles = estimateCycles(best);
+  double budget = cycles / (options.mhz * 1e6 / options.sampleRate) * 100.0;
+  fprintf(stderr,
+          "%-40s %10.2f ns/%-6s %10.1f cycles %8.2f%%\n",
+          name.c_str(),
+          best,
+          unit,
+          cycles,
+          budget);
+}
+
+template<typename Body>
+void benchSamples(const std::string& name, Body&& body) {
+  bench(name, "sample", options.iterations, [] {}, body);
+}
+
+const char* waveformNames[] = {
+  "WAVE_SIN",
+  "WAVE_TRI",
+  "WAVE_SAW",
+  "WAVE_RAMP",
+  "WAVE_SQUARE",
+  "WAVE_POLYBLEP_TRI",
+  "WAVE_POLYBLEP_SAW",
+  "WAVE_POLYBLEP_SQUARE",
+};
+
+const char* filterModeNames[] = {"LP24", "LP12", "BP24", "BP12", "HP24", "HP12"};
+
+const char* arpeggioModeNames[] = {
+  "NO_ARPEGGIO",
+  "UP",
+  "DOWN",
+  "UP_DOWN",
+  "DOWN_UP",
+  "CONVERGE",
+  "DIVERGE",
+  "CONVERGE_DIVERGE",
+  "DIVERGE_CONVERGE",
+  "RANDOM",
+};
+
+// a bandlimited-ish saw to push through filters and saturators
+std::vector<float> makeInput(uint count) {
+  Oscillator oscillator;
+  oscillator.init(options.sampleRate);
+  oscillator.setWaveform(Oscillator::WAVE_POLYBLEP_SAW);
+  oscillator.setFreq(110.f);
+  oscillator.setAmp(0.5f);
+  std::vector<float> input(count);
+  for (auto& sample : input) {
+    sample = oscillator.process();
+  }
+  return input;
+}
+
+// detuned saws a control block at a time, ramping to a new frequency every
+// block like TEP does
+template<uint voices, typename Waveform = WavetableWaveform<WAVETABLE_SAW>>
+void benchOscillatorBank(const std::string& name) {
+  OscillatorBank<voices, Waveform> bank;
+  std::vector<typename Waveform::Sample> block(CONTROL_BLOCK_SIZE);
+  bench(
+    name,
+    "sample",
+    options.iterations / CONTROL_BLOCK_SIZE,
+    [&] {
+      bank.init(options.sampleRate);
+      for (uint voice = 0; voice < voices; voice++) {
+        bank.reset(voice, (float)voice / voices);
+      }
+    },
+    [&](uint i) {
+      bank.rampFreqSpread(55.f + (i & 1023), 0.01f);
+      bank.process(block.data(), CONTROL_BLOCK_SIZE);
+      clobber(block.data());
+    },
+    CONTROL_BLOCK_SIZE);
+}
+
+void benchOscillators() {
+  Oscillator oscillator;
+  for (uint8_t waveform = 0; waveform < Oscillator::WAVE_LAST; waveform++) {
+    oscillator.init(options.sampleRate);
+    oscillator.setWaveform(waveform);
+    oscillator.setFreq(220.f);
+    benchSamples(std::string("oscillator/") + waveformNames[waveform],
+                 [&](uint) { sink = oscillator.process(); });
+  }
+
+  WavetableOscillator wavetable;
+  for (uint8_t waveform = 0; waveform < WavetableOscillator::WAVE_LAST; waveform++) {
+    wavetable.init(options.sampleRate);
+    wavetable.setWaveform(waveform);
+    wavetable.setFreq(220.f);
+    benchSamples(std::string("wavetable/") + waveformNames[waveform],
+                 [&](uint) { sink = wavetable.process(); });
+  }
+
+  // ramping the frequency every sample like TEP does, across octaves
+  wavetable.setWaveform(WavetableOscillator::WAVE_POLYBLEP_SAW);
+  benchSamples("wavetable/setFreq+process", [&](uint i) {
+    wavetable.setFreq(55.f + (i & 4095));
+    sink = wavetable.process();
+  });
+
+  benchOscillatorBank<1>("oscillatorbank/1");
+  benchOscillatorBank<2>("oscillatorbank/2");
+  benchOscillatorBank<4>("oscillatorbank/4");
+  benchOscillatorBank<2, WavetableWaveform<WAVETABLE_SAW, q27>>("fixed/oscillatorbank/2");
+  // a supersaw, against a single oscillator/POLYBLEP_SAW
+  benchOscillatorBank<7>("oscillatorbank/supersaw/wavetable");
+  benchOscillatorBank<7, PolyBlepSaw>("oscillatorbank/supersaw/polyblep");
+
+  VariableSawOscillator variableSaw;
+  variableSaw.init(options.sampleRate);
+  variableSaw.setFreq(220.f);
+  variableSaw.setPW(0.3f);
+  benchSamples("variablesaw/process", [&](uint) { sink = variableSaw.process(); });
+
+  PM2 pm2;
+  pm2.init(options.sampleRate);
+  pm2.setFrequency(220.f);
+  pm2.setDepth(0.5f);
+  benchSamples("pm2/process", [&](uint) { sink = pm2.process(); });
+}
+
+// a control block at a time, with the cutoff ramping across every one of them
+// like the instruments do
+template<typename Filter, typename Sample = float>
+void benchLadderBlock(const std::string& name,
+                      const std::vector<Sample>& input,
+                      LadderFilterMode mode = LadderFilterMode::LP24) {
+  Filter filter;
+  std::vector<Sample> block(CONTROL_BLOCK_SIZE);
+  uint blocksPerInput = input.size() / CONTROL_BLOCK_SIZE;
+  bench(
+    name,
+    "sample",
+    options.iterations / CONTROL_BLOCK_SIZE,
+    [&] {
+      filter.init(options.sampleRate);
+      filter.setFilterMode(mode);
+      filter.setFreq(1000.f);
+      filter.setRes(0.5f);
+    },
+    [&](uint i) {
+      uint offset = (i % blocksPerInput) * CONTROL_BLOCK_SIZE;
+      std::copy(input.begin() + offset, input.begin() + offset + CONTROL_BLOCK_SIZE, block.begin());
+      filter.rampFreq(1000.f + (i & 255));
+      filter.processBlock(block.data(), CONTROL_BLOCK_SIZE);
+      clobber(block.data());
+    },
+    CONTROL_BLOCK_SIZE);
+}
+
+void benchFilters() {
+  std::vector<float> input = makeInput(4096);
+  LadderFilter<> filter;
+
+  for (int mode = 0; mode < 6; mode++) {
+    filter.init(options.sampleRate);
+    filter.setFilterMode(static_cast<LadderFilterMode>(mode));
+    filter.setFreq(1000.f);
+    filter.setRes(0.5f);
+    benchSamples(std::string("ladder/process/") + filterModeNames[mode],
+                 [&](uint i) { sink = filter.process(input[i & 4095]); });
+  }
+
+  for (int mode = 0; mode < 6; mode++) {
+    benchLadderBlock<LadderFilter<>>(std::string("ladder/processBlock/") + filterModeNames[mode],
+                                     input,
+                                     static_cast<LadderFilterMode>(mode));
+  }
+
+  // only compiled for the one mode, like the instruments do
+  benchLadderBlock<LadderFilter<4, LadderFilterMode::LP24>>("ladder/processBlock/LP24-only/4x", input);
+  benchLadderBlock<LadderFilter<2, LadderFilterMode::LP24>>("ladder/processBlock/LP24-only/2x", input);
+  benchLadderBlock<LadderFilter<1, LadderFilterMode::LP24>>("ladder/processBlock/LP24-only/1x", input);
+
+  filter.init(options.sampleRate);
+  benchSamples("ladder/setFreq", [&](uint i) {
+    filter.setFreq(100.f + (i & 4095));
+    clobber(&filter);
+  });
+}
+
+void benchEnvelopes() {
+  AttackOrDecayEnvelope envelope;
+  envelope.init(options.sampleRate);
+  envelope.setTimeAndDirection(0.5f);
+  benchSamples("attackordecay/process", [&](uint i) {
+    if ((i & 4095) == 0) {
+      envelope.trigger();
+    }
+    sink = envelope.process();
+  });
+
+  benchSamples("attackordecay/setTimeAndDirection", [&](uint i) {
+    envelope.setTimeAndDirection((i & 1023) / 512.f - 1.f);
+    clobber(&envelope);
+  });
+}
+
+/*
+Prints the largest and the rms error of approximation against reference over
+count evenly spaced inputs from min to max. The error is relative to the
+reference if relative is set, otherwise absolute.
+*/
+template<typename Approximation, typename Reference>
+void reportError(const std::string& name,
+                 float min,
+                 float max,
+                 Approximation&& approximation,
+                 Reference&& reference,
+                 bool relative = false) {
+  if (!isSelected(name)) {
+    return;
+  }
+
+  const uint count = 1000000;
+  double peak = 0.0;
+  double peakInput = min;
+  double total = 0.0;
+  for (uint i = 0; i <= count; i++) {
+    float in = min + (max - min) * i / count;
+    double expected = reference(in);
+    double error = fabs(approximation(in) - expected);
+    if (relative && expected != 0.0) {
+      error /= fabs(expected);
+    }
+    total += error * error;
+    if (error > peak) {
+      peak = error;
+      peakInput = in;
+    }
+  }
+
+  fprintf(stderr,
+          "%-40s %10.2e %s error max (at %g), %.2e rms\n",
+          name.c_str(),
+          peak,
+          relative ? "relative" : "absolute",
+          peakInput,
+          sqrt(total / (count + 1)));
+}
+
+template<SaturationAccuracy accuracy>
+void benchTanh(const std::string& tier, const std::vector<float>& input) {
+  benchSamples("saturation/tanhRational/" + tier,
+               [&](uint i) { sink = tanhRational<accuracy>(input[i & 4095] * 4.f); });
+  benchSamples("saturation/tanhLookup/" + tier,
+               [&](uint i) { sink = tanhLookup<accuracy>(input[i & 4095] * 4.f); });
+  reportError("saturation/tanhRational/" + tier + "/error",
+              -8.f,
+              8.f,
+              [](float x) { return tanhRational<accuracy>(x); },
+              [](float x) { return tanh((double)x); });
+  reportError("saturation/tanhLookup/" + tier + "/error",
+              -8.f,
+              8.f,
+              [](float x) { return tanhLookup<accuracy>(x); },
+              [](float x) { return tanh((double)x); });
+}
+
+void benchSaturation() {
+  std::vector<float> input = makeInput(4096);
+  benchSamples("utils/softClip", [&](uint i) { sink = softClip(input[i & 4095] * 4.f); });
+  benchTanh<SaturationAccuracy::Low>("Low", input);
+  benchTanh<SaturationAccuracy::Medium>("Medium", input);
+  benchTanh<SaturationAccuracy::High>("High", input);
+
+  Overdrive overdrive;
+  overdrive.init(0.35f);
+  overdrive.setAmount(0.5f);
+  benchSamples("saturation/overdrive/process",
+               [&](uint i) { sink = overdrive.process(input[i & 4095]); });
+  bench("saturation/overdrive/setAmount", "call", options.iterations / 10, [] {}, [&](uint i) {
+    overdrive.setAmount((i & 1) ? 0.25f : 0.75f);
+    clobber(&overdrive);
+  });
+
+  // against the powf() it replaced, over all the octaves the table covers
+  for (float amount : {0.f, 0.5f, 1.f}) {
+    overdrive.setAmount(amount);
+    char name[64];
+    snprintf(name, sizeof(name), "saturation/overdrive/%g/error", amount);
+    reportError(
+      name,
+      -(float)Overdrive::octaves,
+      0.f,
+      [&](float octave) { return overdrive.getPower(exp2f(octave)); },
+      [&](float octave) { return pow(exp2((double)octave), 1.0 / (1.0 + amount * 2.0)); },
+      true);
+  }
+}
+
+/*
+Prints how loud the aliasing is that process(float* block, size_t count) makes
+of a 5kHz sine, against the sine. The sine fits a whole number of cycles into
+the measured stretch, so everything in the output that isn't at its frequency
+(or its second harmonic, the only other one below the Nyquist frequency at
+24kHz) is aliasing.
+*/
+template<typename Process>
+void reportAliasing(const std::string& name, Process&& process) {
+  if (!isSelected(name)) {
+    return;
+  }
+
+  const uint count = 4800;
+  const float freq = 5000.f;
+  // twice as much, the first half for the resamplers' delay to settle
+  std::vector<float> buf(2 * count);
+  for (uint i = 0; i < buf.size(); i++) {
+    buf[i] = sinf(2.f * (float)M_PI * freq / 24000.f * i);
+  }
+  for (uint i = 0; i < buf.size(); i += CONTROL_BLOCK_SIZE) {
+    process(buf.data() + i, CONTROL_BLOCK_SIZE);
+  }
+
+  // the harmonics by correlation, the rest is aliasing
+  double harmonics = 0.0, total = 0.0;
+  for (uint harmonic = 1; harmonic <= 2; harmonic++) {
+    double re = 0.0, im = 0.0;
+    for (uint i = count; i < 2 * count; i++) {
+      double angle = 2.0 * M_PI * freq * harmonic / 24000.0 * i;
+      re += buf[i] * cos(angle);
+      im += buf[i] * sin(angle);
+    }
+    double power = 2.0 * (re * re + im * im) / ((double)count * count);
+    if (harmonic == 1) {
+      harmonics = power;
+    }
+    total += power;
+  }
+  double all = 0.0;
+  for (uint i = count; i < 2 * count; i++) {
+    all += (double)buf[i] * buf[i] / count;
+  }
+  fprintf(stderr, "%-40s %10.1f dB aliasing\n", name.c_str(), 10.0 * log10((all - total) / harmonics));
+}
+
+// The half-band resamplers on their own and wrapped around a clipper, against
+// oversampling by interpolating linearly and averaging like LadderFilter does
+void benchResample() {
+  std::vector<float> input = makeInput(4096);
+  std::vector<float> block(4 * CONTROL_BLOCK_SIZE);
+
+  Upsampler<2> up2;
+  Upsampler<4> up4;
+  Downsampler<2> down2;
+  Downsampler<4> down4;
+  up2.init();
+  up4.init();
+  down2.init();
+  down4.init();
+  auto benchBlocks = [&](const std::string& name, auto&& process) {
+    bench(
+      name,
+      "sample",
+      options.iterations / CONTROL_BLOCK_SIZE,
+      [] {},
+      [&](uint i) {
+        process(&input[(i * CONTROL_BLOCK_SIZE) & 4095]);
+        clobber(block.data());
+      },
+      CONTROL_BLOCK_SIZE);
+  };
+  benchBlocks("resample/up/2x", [&](float* in) { up2.process(in, block.data(), CONTROL_BLOCK_SIZE); });
+  benchBlocks("resample/up/4x", [&](float* in) { up4.process(in, block.data(), CONTROL_BLOCK_SIZE); });
+  // per sample at the normal rate, which is 2 or 4 going in
+  benchBlocks("resample/down/2x", [&](float* in) {
+    std::copy(in, in + CONTROL_BLOCK_SIZE, block.begin());
+    down2.process(block.data(), block.data(), CONTROL_BLOCK_SIZE / 2);
+  });
+  benchBlocks("resample/down/4x", [&](float* in) {
+    std::copy(in, in + CONTROL_BLOCK_SIZE, block.begin());
+    down4.process(block.data(), block.data(), CONTROL_BLOCK_SIZE / 4);
+  });
+
+  auto clip = [](float x) { return tanhRational(3.f * x); };
+  Oversampler<2> oversampler2;
+  Oversampler<4> oversampler4;
+  oversampler2.init();
+  oversampler4.init();
+  auto clip2x = [&](float* buf, size_t size) {
+    oversampler2.processBlock(buf, size, [&](float* oversampled, size_t count) {
+      for (size_t i = 0; i < count; i++) {
+        oversampled[i] = clip(oversampled[i]);
+      }
+    });
+  };
+  auto clip4x = [&](float* buf, size_t size) {
+    oversampler4.processBlock(buf, size, [&](float* oversampled, size_t count) {
+      for (size_t i = 0; i < count; i++) {
+        oversampled[i] = clip(oversampled[i]);
+      }
+    });
+  };
+  float previous = 0.f;
+  auto clipLinear4x = [&](float* buf, size_t size) {
+    for (size_t i = 0; i < size; i++) {
+      float total = 0.f;
+      for (uint os = 0; os < 4; os++) {
+        total += clip(previous + (buf[i] - previous) * (os + 1) * 0.25f) * 0.25f;
+      }
+      previous = buf[i];
+      buf[i] = total;
+    }
+  };
+  benchBlocks("resample/clip/2x", [&](float* in) {
+    std::copy(in, in + CONTROL_BLOCK_SIZE, block.begin());
+    clip2x(block.data(), CONTROL_BLOCK_SIZE);
+  });
+  benchBlocks("resample/clip/4x", [&](float* in) {
+    std::copy(in, in + CONTROL_BLOCK_SIZE, block.begin());
+    clip4x(block.data(), CONTROL_BLOCK_SIZE);
+  });
+  benchBlocks("resample/clip/linear4x", [&](float* in) {
+    std::copy(in, in + CONTROL_BLOCK_SIZE, block.begin());
+    clipLinear4x(block.data(), CONTROL_BLOCK_SIZE);
+  });
+
+  reportAliasing("resample/clip/1x/aliasing", [&](float* buf, size_t size) {
+    for (size_t i = 0; i < size; i++) {
+      buf[i] = clip(buf[i]);
+    }
+  });
+  oversampler2.init();
+  oversampler4.init();
+  previous = 0.f;
+  reportAliasing("resample/clip/2x/aliasing", clip2x);
+  reportAliasing("resample/clip/4x/aliasing", clip4x);
+  reportAliasing("resample/clip/linear4x/aliasing", clipLinear4x);
+
+  benchLadderBlock<HalfBandLadderFilter<4, LadderFilterMode::LP24>>(
+    "ladder/processBlock/LP24-only/halfband/4x", input);
+  benchLadderBlock<HalfBandLadderFilter<2, LadderFilterMode::LP24>>(
+    "ladder/processBlock/LP24-only/halfband/2x", input);
+
+  // open, resonant and driven hard, so the clipper makes plenty to alias
+  auto reportLadderAliasing = [&](const std::string& name, auto& filter) {
+    filter.init(24000.f);
+    filter.setFreq(10000.f);
+    filter.setRes(0.5f);
+    filter.setInputDrive(3.f);
+    reportAliasing(name, [&](float* buf, size_t size) { filter.processBlock(buf, size); });
+  };
+  LadderFilter<4, LadderFilterMode::LP24> linearLadder;
+  HalfBandLadderFilter<4, LadderFilterMode::LP24> halfBandLadder4;
+  HalfBandLadderFilter<2, LadderFilterMode::LP24> halfBandLadder2;
+  reportLadderAliasing("ladder/LP24/4x/aliasing", linearLadder);
+  reportLadderAliasing("ladder/LP24/halfband/4x/aliasing", halfBandLadder4);
+  reportLadderAliasing("ladder/LP24/halfband/2x/aliasing", halfBandLadder2);
+}
+
+// the Q27 versions of the blocks in TEP's voice, see lib/fixed.hpp
+void benchFixed() {
+  std::vector<float> input = makeInput(4096);
+  std::vector<q27> fixedInput(input.size());
+  for (uint i = 0; i < input.size(); i++) {
+    fixedInput[i] = floatToQ27(input[i]);
+  }
+
+  FixedWavetableOscillator wavetable;
+  wavetable.init(options.sampleRate);
+  wavetable.setWaveform(FixedWavetableOscillator::WAVE_POLYBLEP_SAW);
+  wavetable.setFreq(220.f);
+  benchSamples("fixed/wavetable/POLYBLEP_SAW", [&](uint) { fixedSink = wavetable.process(); });
+
+  benchLadderBlock<FixedLadderFilter<4, LadderFilterMode::LP24>, q27>(
+    "fixed/ladder/processBlock/LP24-only/4x", fixedInput);
+  benchLadderBlock<FixedLadderFilter<2, LadderFilterMode::LP24>, q27>(
+    "fixed/ladder/processBlock/LP24-only/2x", fixedInput);
+
+  benchSamples("fixed/softClip",
+               [&](uint i) { fixedSink = softClipQ27(fixedInput[i & 4095] * 4); });
+
+  FixedOverdrive overdrive;
+  overdrive.init(0.35f);
+  overdrive.setAmount(0.5f);
+  benchSamples("fixed/overdrive/process",
+               [&](uint i) { fixedSink = overdrive.process(fixedInput[i & 4095]); });
+}
+
+void benchQuantize() {
+  benchSamples("quantize/getFrequencyForNote",
+               [&](uint i) { sink = getFrequencyForNote(0, (i & 1023) / 1024.f * 76.f); });
+  benchSamples("quantize/addSemitonesToFrequency",
+               [&](uint i) { sink = addSemitonesToFrequency(220.f, (i & 1023) / 1024.f * 24.f); });
+  benchSamples("quantize/powf", [&](uint i) {
+    sink = 220.f * powf(2.f, (i & 1023) / 1024.f * 24.f / 12.f);
+  });
+  reportError(
+    "pitch/semitonesToRatio/error",
+    -48.f,
+    48.f,
+    [](float semitones) { return semitonesToRatio(semitones); },
+    [](float semitones) { return pow(2.0, semitones / 12.0); },
+    true);
+  benchSamples("quantize/getSemitoneOffsetForNote", [&](uint i) {
+    sink = getSemitoneOffsetForNote(SCALE_MAJOR, (i & 1023) / 512.f - 1.f);
+  });
+  // what PMD asks for on every note
+  benchSamples("quantize/quantizeAmount", [&](uint i) {
+    sink = quantizeAmount(SCALE_HARMONIC_MINOR, (i & 1023) / 512.f - 1.f).chord;
+  });
+  benchSamples("quantize/getChordScaleDegreeForNote", [&](uint i) {
+    sink = getChordScaleDegreeForNote(SCALE_HARMONIC_MINOR, (i & 1023) / 512.f - 1.f);
+  });
+
+  NoteQuantizer quantizer;
+  quantizer.setScaleAndPitchAmount(SCALE_UNQUANTIZED, 0.5f, 0.5f);
+  benchSamples("quantize/NoteQuantizer/unquantized", [&](uint i) {
+    sink = quantizer.getOscillatorFrequency((i & 1023) / 1024.f, 0.25f);
+  });
+  quantizer.setScaleAndPitchAmount(SCALE_MAJOR, 0.5f, 0.5f);
+  benchSamples("quantize/NoteQuantizer/major", [&](uint i) {
+    sink = quantizer.getOscillatorFrequency((i & 1023) / 1024.f, 0.25f);
+  });
+}
+
+void benchArpeggio() {
+  Arpeggio arpeggio;
+  const float values[] = {110.f, 130.8f, 164.8f, 196.f};
+  arpeggio.setValues(values, 4);
+  for (int mode = 0; mode < 10; mode++) {
+    arpeggio.setMode(static_cast<ArpeggioMode>(mode));
+    bench(std::string("arpeggio/process/") + arpeggioModeNames[mode],
+          "call",
+          options.iterations,
+          [&] { arpeggio.reset(); },
+          [&](uint) { sink = arpeggio.process(); });
+  }
+}
+
+void benchRandom() {
+  Random random(1);
+  // what the instruments used before lib/random.hpp
+  bench("random/rand", "call", options.iterations, [] {}, [&](uint) {
+    sink = (float)rand() / RAND_MAX;
+  });
+  bench("random/mt19937/seed", "call", options.iterations / 100, [] {}, [&](uint i) {
+    std::mt19937 generator(i);
+    sink = generator();
+  });
+  bench("random/next", "call", options.iterations, [] {}, [&](uint) {
+    sink = random.next();
+  });
+  bench("random/nextFloat", "call", options.iterations, [] {}, [&](uint) {
+    sink = random.nextFloat();
+  });
+  bench("random/nextBipolar", "call", options.iterations, [] {}, [&](uint) {
+    sink = random.nextBipolar();
+  });
+  bench("random/nextGaussian", "call", options.iterations, [] {}, [&](uint) {
+    sink = random.nextGaussian();
+  });
+  bench("random/seed", "call", options.iterations, [] {}, [&](uint i) {
+    random.seed(i);
+    sink = random.next();
+  });
+}
+
+void benchSequencer() {
+  uint iterations = options.iterations / 100;
+  Sequencer sequencer;
+
+  // changing a parameter and then the tick that regenerates for it
+  bench("sequencer/setComplexity", "call", iterations, [] {}, [&](uint i) {
+    sequencer.setComplexity(15 + (i & 1));
+    sink = sequencer.process().second;
+  });
+  bench("sequencer/setBias", "call", iterations, [] {}, [&](uint i) {
+    sequencer.setBias((i & 1) ? 0.4f : 0.6f);
+    sink = sequencer.process().second;
+  });
+  bench("sequencer/setSpread", "call", iterations, [] {}, [&](uint i) {
+    sequencer.setSpread((i & 1) ? 0.4f : 0.6f);
+    sink = sequencer.process().second;
+  });
+  bench("sequencer/setDensity", "call", iterations, [] {}, [&](uint i) {
+    sequencer.setDensity((i & 1) ? 0.4f : 0.6f);
+    sink = sequencer.process().second;
+  });
+  // what PMD does every tick while nobody turns a knob
+  bench("sequencer/tick/unchanged", "call", options.iterations, [] {}, [&](uint) {
+    sequencer.setSequenceLength(16);
+    sequencer.setComplexity(16);
+    sequencer.setDensity(0.5f);
+    sequencer.setSpread(0.5f);
+    sequencer.setBias(0.4f);
+    sink = sequencer.process().second;
+  });
+  bench("sequencer/process", "call", options.iterations, [] {}, [&](uint) {
+    sink = sequencer.process().second;
+  });
+}
+
+template<typename Instrument>
+void benchInstrument(const std::string& name) {
+  if (!isSelected(name)) {
+    return;
+  }
+
+  host::QuietStdout quiet;
+  host::Board board;
+  std::vector<int16_t> samples(host::samplesPerBuffer);
+  host::Runner<Instrument>* runner = nullptr;
+  uint numBuffers = options.iterations / host::samplesPerBuffer + 1;
+
+  bench(
+    name,
+    "sample",
+    numBuffers,
+    [&] {
+      delete runner;
+      board.init();
+      for (uint i = 1; i <= 16; i++) {
+        board.setKnob(i, 0.5f);
+      }
+      host::seedRandom(1);
+      runner = new host::Runner<Instrument>(options.sampleRate);
+      runner->init();
+    },
+    [&](uint) { runner->renderBuffer(samples.data(), host::samplesPerBuffer); },
+    host::samplesPerBuffer);
+  delete runner;
+}
+
+void writeJson(FILE* file) {
+  fprintf(file, "{\n");
+  fprintf(file, "  \"mhz\": %g,\n", options.mhz);
+  fprintf(file, "  \"scale\": %g,\n", options.scale);
+  fprintf(file, "  \"sample_rate\": %g,\n", options.sampleRate);
+  fprintf(file, "  \"iterations\": %u,\n", options.iterations);
+  fprintf(file, "  \"results\": [\n");
+  for (size_t i = 0; i < results.size(); i++) {
+    auto& result = results[i];
+    double cycles = estimateCycles(result.ns);
+    fprintf(file,
+            "    {\"name\": \"%s\", \"unit\": \"%s\", \"ns\": %.3f, \"cycles\": %.1f}%s\n",
+            result.name.c_str(),
+            result.unit,
+            result.ns,
+            cycles,
+            i + 1 < results.size() ? "," : "");
+  }
+  fprintf(file, "  ]\n");
+  fprintf(file, "}\n");
+}
+
+int main(int argc, char** argv) {
+  for (int i = 1; i < argc; i++) {
+    const char* arg = argv[i];
+    bool hasValue = i + 1 < argc;
+    if (strcmp(arg, "-o") == 0 && hasValue) {
+      options.outputPath = argv[++i];
+    } else if (strcmp(arg, "-n") == 0 && hasValue) {
+      options.iterations = strtoul(argv[++i], nullptr, 0);
+    } else if (strcmp(arg, "-f") == 0 && hasValue) {
+      options.filter = argv[++i];
+    } else if (strcmp(arg, "--mhz") == 0 && hasValue) {
+      options.mhz = atof(argv[++i]);
+    } else if (strcmp(arg, "--scale") == 0 && hasValue) {
+      options.scale = atof(argv[++i]);
+    } else if (strcmp(arg, "--rate") == 0 && hasValue) {
+      options.sampleRate = atof(argv[++i]);
+    } else {
+      fprintf(stderr,
+              "usage: platform16_bench [-o results.json] [-n iterations] [-f filter] [--mhz mhz]\n"
+              "                        [--scale x] [--rate rate]\n");
+      return 1;
+    }
+  }
+  if (options.iterations < 100) {
+    options.iterations = 100;
+  }
+
+  srand(1);
+  host::halfSampleRate = options.sampleRate / 2.f;
+
+  benchOscillators();
+  benchFilters();
+  benchEnvelopes();
+  benchSaturation();
+  benchResample();
+  benchFixed();
+  benchQuantize();
+  benchArpeggio();
+  benchRandom();
+  benchSequencer();
+  benchInstrument<TEPInstrument>("instrument/tep");
+  benchInstrument<SDSInstrument>("instrument/sds");
+  benchInstrument<PMDInstrument>("instrument/pmd");
+
+  FILE* file = options.outputPath.empty() ? stdout : fopen(options.outputPath.c_str(), "w");
+  if (!file) {
+    fprintf(stderr, "%s: can't write results\n", options.outputPath.c_str());
+    return 1;
+  }
+  writeJson(file);
+  if (file != stdout) {
+    fclose(file);
+  }
+  return 0;
+}
@@ -0,0 +1,61 @@
+#ifndef PLATFORM_HOST_BOARD_H
+#define PLATFORM_HOST_BOARD_H
+
+#include "hal/hal.hpp"
+
+#include "../lib/gpio.hpp"
+#include "../lib/pots.hpp"
+
+namespace host {
+
+// the multiplexer channel for each knob, K1 to K16
+const uint knobChannels[16] = {K1, K2, K3, K4, K5, K6, K7, K8, K9, K10, K11, K12, K13, K14, K15, K16};
+
+/*
+A virtual platform16: wires the stand-in HAL up the same way the real board is
+wired so host code can talk in terms of knobs and clock jacks rather than pins.
+*/
+struct Board {
+  void init() {
+    hal.reset();
+    hal.connectMux(S0_PIN, S1_PIN, S2_PIN, S3_PIN);
+    hal.watch(CLOCK_OUT_PIN);
+    setClockConnected(false);
+    setClockIn(false);
+    for (uint i = 1; i <= 16; i++) {
+      setKnob(i, 0.f);
+    }
+  }
+
+  // knob is 1 to 16 (K1 to K16), value is 0 to 1
+  void setKnob(uint knob, float value) {
+    hal.setAdcChannel(knobChannels[knob - 1], value);
+  }
+
+  void setClockConnected(bool connected) {
+    hal.setPin(CLOCK_IN_CONNECTED_PIN, connected);
+  }
+
+  // value is the logical level of the clock input. The pin itself is inverted
+  // because it is tied to an NPN transistor.
+  void setClockIn(bool value) {
+    hal.setPin(CLOCK_IN_PIN, !value);
+  }
+
+  bool getClockOut() {
+    return hal.getPin(CLOCK_OUT_PIN);
+  }
+
+  // every change of the clock out pin since init()
+  const std::vector<PinEdge>& getClockOutEdges() {
+    return hal.edges;
+  }
+
+  uint64_t getSample() {
+    return hal.sample;
+  }
+};
+
+}  // namespace host
+
+#endif  // PLATFORM_HOST_BOARD_H
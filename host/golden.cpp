@@ -0,0 +1,307 @@
+/*
+Golden-audio regression check. Renders every scene in golden/scenes.txt with a
+fixed seed and compares it against the reference wav checked in next to it, so
+that optimisations can be checked for not changing the sound (or for changing
+it by less than an agreed amount).
+
+A scene passes if it is bit-exact or, unless --exact is given, if the error
+stays within both thresholds: the signal to error ratio over the whole scene
+and the peak error of any one sample. Failing scenes get a per-buffer report
+of where the error is.
+
+usage: platform16_golden [options] [scene...]
+  --dir <path>    directory with scenes.txt, the scripts and the references
+  --exact         only accept bit-exact output
+  --snr <dB>      minimum signal to error ratio (default 60)
+  --peak <lsb>    maximum error of any one sample in 16 bit steps (default 64)
+  --update        (re)write the references instead of comparing
+  -v              also report on scenes that pass
+*/
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include "render.hpp"
+#include "wav.hpp"
+
+#ifndef PLATFORM16_GOLDEN_DIR
+#define PLATFORM16_GOLDEN_DIR "golden"
+#endif
+
+struct GoldenOptions {
+  std::string dir = PLATFORM16_GOLDEN_DIR;
+  std::vector<std::string> only;
+  bool exact = false;
+  double minSnr = 60.0;
+  int maxPeak = 64;
+  bool update = false;
+  bool verbose = false;
+};
+
+struct Scene {
+  std::string name;
+  std::string firmware;
+  float seconds;
+  uint32_t seed;
+};
+
+struct BlockError {
+  size_t block;
+  int peak;
+  double snr;
+};
+
+// how many of the worst buffers to list for a failing scene
+const size_t maxReportedBlocks = 8;
+
+const float goldenSampleRate = 24000.f;
+
+void usage() {
+  fprintf(stderr,
+          "usage: platform16_golden [--dir path] [--exact] [--snr dB] [--peak lsb] [--update] [-v]\n"
+          "                         [scene...]\n");
+}
+
+// signal to error ratio in dB, infinite if there is no error
+double snr(double signal, double error) {
+  if (error == 0.0) {
+    return INFINITY;
+  }
+  return 10.0 * log10((signal > 0.0 ? signal : 1.0) / error);
+}
+
+bool loadScenes(const std::string& path, std::vector<Scene>& scenes) {
+  FILE* file = fopen(path.c_str(), "r");
+  if (!file) {
+    fprintf(stderr, "%s: can't open scenes\n", path.c_str());
+    return false;
+  }
+
+  char line[256];
+  int lineNumber = 0;
+  bool ok = true;
+  while (fgets(line, sizeof(line), file)) {
+    lineNumber++;
+    char* comment = strchr(line, '#');
+    if (comment) {
+      *comment = '\0';
+    }
+
+    char name[64], firmware[16];
+    Scene scene;
+    int count = sscanf(line, "%63s %15s %f %u", name, firmware, &scene.seconds, &scene.seed);
+    if (count <= 0) {
+      continue;
+    }
+    if (count != 4 || scene.seconds <= 0.f) {
+      fprintf(stderr, "%s:%d: expected <name> <firmware> <seconds> <seed>\n", path.c_str(), lineNumber);
+      ok = false;
+      continue;
+    }
+    scene.name = name;
+    scene.firmware = firmware;
+    scenes.push_back(scene);
+  }
+
+  fclose(file);
+  return ok;
+}
+
+bool compare(const Scene& scene,
+             const std::vector<int16_t>& expected,
+             const std::vector<int16_t>& actual,
+             const GoldenOptions& options) {
+  const char* name = scene.name.c_str();
+
+  if (expected.size() != actual.size()) {
+    printf("%s: FAIL, rendered %zu samples but the reference has %zu\n",
+           name,
+           actual.size(),
+           expected.size());
+    return false;
+  }
+
+  double signal = 0.0;
+  double error = 0.0;
+  int peak = 0;
+  size_t peakSample = 0;
+  size_t differing = 0;
+  std::vector<BlockError> blocks;
+
+  for (size_t offset = 0; offset < expected.size(); offset += host::samplesPerBuffer) {
+    size_t end = std::min(offset + host::samplesPerBuffer, expected.size());
+    double blockSignal = 0.0;
+    double blockError = 0.0;
+    int blockPeak = 0;
+
+    for (size_t i = offset; i < end; i++) {
+      int difference = abs(actual[i] - expected[i]);
+      blockSignal += (double)expected[i] * expected[i];
+      blockError += (double)difference * difference;
+      if (difference) {
+        differing++;
+      }
+      if (difference > blockPeak) {
+        blockPeak = difference;
+      }
+      if (difference > peak) {
+        peak = difference;
+        peakSample = i;
+      }
+    }
+
+    signal += blockSignal;
+    error += blockError;
+    if (blockPeak) {
+      blocks.push_back({offset / host::samplesPerBuffer, blockPeak, snr(blockSignal, blockError)});
+    }
+  }
+
+  if (!differing) {
+    if (options.verbose) {
+      printf("%s: ok, bit-exact\n", name);
+    }
+    return true;
+  }
+
+  double totalSnr = snr(signal, error);
+  bool pass = !options.exact && totalSnr >= options.minSnr && peak <= options.maxPeak;
+
+  if (pass && !options.verbose) {
+    return true;
+  }
+
+  printf("%s: %s, %zu of %zu samples differ, snr %.1f dB, peak error %d at %.3fs\n",
+         name,
+         pass ? "ok" : "FAIL",
+         differing,
+         expected.size(),
+         totalSnr,
+         peak,
+         peakSample / goldenSampleRate);
+
+  if (!pass) {
+    // the worst buffers first, then listed in time order
+    std::sort(blocks.begin(), blocks.end(), [](const BlockError& a, const BlockError& b) {
+      return a.peak > b.peak;
+    });
+    size_t shown = std::min(blocks.size(), maxReportedBlocks);
+    std::sort(blocks.begin(), blocks.begin() + shown, [](const BlockError& a, const BlockError& b) {
+      return a.block < b.block;
+    });
+    for (size_t i = 0; i < shown; i++) {
+      auto& block = blocks[i];
+      printf("  buffer %zu (%.3fs): peak error %d, snr %.1f dB\n",
+             block.block,
+             block.block * host::samplesPerBuffer / goldenSampleRate,
+             block.peak,
+             block.snr);
+    }
+    if (blocks.size() > shown) {
+      printf("  ... and %zu more buffers with errors\n", blocks.size() - shown);
+    }
+  }
+
+  return pass;
+}
+
+bool runScene(const Scene& scene, const GoldenOptions& options) {
+  std::string base = options.dir + "/" + scene.name;
+
+  host::Script script;
+  if (!script.load((base + ".txt").c_str())) {
+    return false;
+  }
+
+  host::RenderSettings settings;
+  settings.sampleRate = goldenSampleRate;
+  settings.numSamples = (uint64_t)(scene.seconds * goldenSampleRate);
+  settings.seed = scene.seed;
+
+  host::Board board;
+  std::vector<int16_t> actual;
+  if (!host::renderFirmware(scene.firmware, script, settings, board, actual)) {
+    fprintf(stderr, "%s: unknown firmware %s\n", scene.name.c_str(), scene.firmware.c_str());
+    return false;
+  }
+
+  std::string referencePath = base + ".wav";
+  if (options.update) {
+    if (!host::writeWav(referencePath.c_str(), actual, (uint32_t)goldenSampleRate)) {
+      fprintf(stderr, "%s: can't write wav file\n", referencePath.c_str());
+      return false;
+    }
+    printf("%s: updated %s\n", scene.name.c_str(), referencePath.c_str());
+    return true;
+  }
+
+  std::vector<int16_t> expected;
+  uint32_t sampleRate = 0;
+  if (!host::readWav(referencePath.c_str(), expected, sampleRate) ||
+      sampleRate != (uint32_t)goldenSampleRate) {
+    fprintf(stderr, "%s: can't read reference (run with --update to create it)\n", referencePath.c_str());
+    return false;
+  }
+
+  return compare(scene, expected, actual, options);
+}
+
+int main(int argc, char** argv) {
+  GoldenOptions options;
+
+  for (int i = 1; i < argc; i++) {
+    const char* arg = argv[i];
+    bool hasValue = i + 1 < argc;
+    if (strcmp(arg, "--dir") == 0 && hasValue) {
+      options.dir = argv[++i];
+    } else if (strcmp(arg, "--exact") == 0) {
+      options.exact = true;
+    } else if (strcmp(arg, "--snr") == 0 && hasValue) {
+      options.minSnr = atof(argv[++i]);
+    } else if (strcmp(arg, "--peak") == 0 && hasValue) {
+      options.maxPeak = atoi(argv[++i]);
+    } else if (strcmp(arg, "--update") == 0) {
+      options.update = true;
+    } else if (strcmp(arg, "-v") == 0) {
+      options.verbose = true;
+    } else if (arg[0] != '-') {
+      options.only.push_back(arg);
+    } else {
+      usage();
+      return 1;
+    }
+  }
+
+  std::vector<Scene> scenes;
+  if (!loadScenes(options.dir + "/scenes.txt", scenes)) {
+    return 1;
+  }
+
+  int failed = 0;
+  int run = 0;
+  for (auto& scene : scenes) {
+    if (!options.only.empty() &&
+        std::find(options.only.begin(), options.only.end(), scene.name) == options.only.end()) {
+      continue;
+    }
+    run++;
+    if (!runScene(scene, options)) {
+      failed++;
+    }
+  }
+
+  if (!run) {
+    fprintf(stderr, "no scenes to run\n");
+    return 1;
+  }
+  if (!options.update) {
+    printf("%d of %d scenes passed\n", run - failed, run);
+  }
+  return failed ? 1 : 0;
+}
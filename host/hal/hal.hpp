@@ -0,0 +1,128 @@
+#ifndef PLATFORM_HOST_HAL_H
+#define PLATFORM_HOST_HAL_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/types.h>
+
+#include <vector>
+
+#include "../../lib/allocguard.hpp"
+
+namespace host {
+
+/*
+This stands in for the parts of the Pico SDK that the firmware touches so that
+the instruments can be built and run on a desktop machine. The headers next to
+this one (pico/stdlib.h, hardware/gpio.h, hardware/adc.h, ...) forward to it.
+
+It only models pins and the ADC:
+- output pins remember the last value that was put
+- input pins return whatever the host code scripted for them
+- adc_read() returns the scripted value for whichever multiplexer channel the
+  four select pins currently address
+- edges on watched pins get recorded along with the sample they happened on
+*/
+
+const uint numPins = 48;
+const uint numAdcChannels = 16;
+
+struct PinEdge {
+  uint64_t sample;
+  uint pin;
+  bool value;
+};
+
+struct Hal {
+  Hal() {
+    reset();
+  }
+
+  void reset() {
+    for (uint i = 0; i < numPins; i++) {
+      pins[i] = false;
+      watched[i] = false;
+    }
+    for (uint i = 0; i < numAdcChannels; i++) {
+      adcChannels[i] = 0;
+    }
+    for (uint i = 0; i < 4; i++) {
+      muxPins[i] = 0;
+    }
+    sample = 0;
+    randState = 0;
+    edges.clear();
+  }
+
+  // which pins address the analog multiplexer in front of the ADC
+  void connectMux(uint s0, uint s1, uint s2, uint s3) {
+    muxPins[0] = s0;
+    muxPins[1] = s1;
+    muxPins[2] = s2;
+    muxPins[3] = s3;
+  }
+
+  uint getMuxChannel() {
+    return (pins[muxPins[0]] ? 1 : 0) | (pins[muxPins[1]] ? 2 : 0) | (pins[muxPins[2]] ? 4 : 0) |
+      (pins[muxPins[3]] ? 8 : 0);
+  }
+
+  // value is 0 to 1 and gets converted to a 12 bit reading
+  void setAdcChannel(uint channel, float value) {
+    value = value < 0.f ? 0.f : (value > 1.f ? 1.f : value);
+    adcChannels[channel] = (uint16_t)(value * 4095.f + 0.5f);
+  }
+
+  uint16_t readAdc() {
+    return adcChannels[getMuxChannel()];
+  }
+
+  void setPin(uint pin, bool value) {
+    if (watched[pin] && pins[pin] != value) {
+      // the instruments put pins in the audio path, recording them is host only
+      ALLOW_ALLOC_SCOPE();
+      edges.push_back({sample, pin, value});
+    }
+    pins[pin] = value;
+  }
+
+  bool getPin(uint pin) {
+    return pins[pin];
+  }
+
+  void watch(uint pin) {
+    watched[pin] = true;
+  }
+
+  // the host code calls this after rendering samples so edges can be timed
+  void advance(uint64_t count = 1) {
+    sample += count;
+  }
+
+  void seedRand(uint64_t seed) {
+    randState = seed;
+  }
+
+  // splitmix64 so that get_rand_32() is reproducible on the host
+  uint32_t nextRand() {
+    uint64_t z = (randState += 0x9e3779b97f4a7c15ull);
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+    return (uint32_t)((z ^ (z >> 31)) >> 32);
+  }
+
+  bool pins[numPins];
+  bool watched[numPins];
+  uint16_t adcChannels[numAdcChannels];
+  uint muxPins[4];
+  uint64_t sample;
+  uint64_t randState;
+  std::vector<PinEdge> edges;
+};
+
+inline Hal hal;
+
+}  // namespace host
+
+#endif  // PLATFORM_HOST_HAL_H
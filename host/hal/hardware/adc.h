@@ -0,0 +1,20 @@
+#ifndef PLATFORM_HOST_HARDWARE_ADC_H
+#define PLATFORM_HOST_HARDWARE_ADC_H
+
+// Host stand-in for the Pico SDK's hardware/adc.h. See hal.hpp.
+
+#include "../hal.hpp"
+
+inline void adc_init() {}
+
+inline void adc_gpio_init(uint gpio) {}
+
+inline void adc_select_input(uint input) {}
+
+inline void adc_set_temp_sensor_enabled(bool enable) {}
+
+inline uint16_t adc_read() {
+  return host::hal.readAdc();
+}
+
+#endif  // PLATFORM_HOST_HARDWARE_ADC_H
@@ -0,0 +1,25 @@
+#ifndef PLATFORM_HOST_HARDWARE_GPIO_H
+#define PLATFORM_HOST_HARDWARE_GPIO_H
+
+// Host stand-in for the Pico SDK's hardware/gpio.h. See hal.hpp.
+
+#include "../hal.hpp"
+
+#define GPIO_OUT 1
+#define GPIO_IN 0
+
+inline void gpio_init(uint gpio) {
+  host::hal.setPin(gpio, false);
+}
+
+inline void gpio_set_dir(uint gpio, bool out) {}
+
+inline void gpio_put(uint gpio, bool value) {
+  host::hal.setPin(gpio, value);
+}
+
+inline bool gpio_get(uint gpio) {
+  return host::hal.getPin(gpio);
+}
+
+#endif  // PLATFORM_HOST_HARDWARE_GPIO_H
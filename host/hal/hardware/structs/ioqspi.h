@@ -0,0 +1,7 @@
+#ifndef PLATFORM_HOST_HARDWARE_STRUCTS_IOQSPI_H
+#define PLATFORM_HOST_HARDWARE_STRUCTS_IOQSPI_H
+
+// Host stand-in for the Pico SDK's hardware/structs/ioqspi.h. Nothing the host build uses
+// lives in here, it only exists so that lib/gpio.hpp compiles.
+
+#endif  // PLATFORM_HOST_HARDWARE_STRUCTS_IOQSPI_H
@@ -0,0 +1,13 @@
+#ifndef PLATFORM_HOST_PICO_RAND_H
+#define PLATFORM_HOST_PICO_RAND_H
+
+// Host stand-in for the Pico SDK's pico/rand.h. Seed it with
+// host::hal.seedRand() to get reproducible values.
+
+#include "../hal.hpp"
+
+inline uint32_t get_rand_32() {
+  return host::hal.nextRand();
+}
+
+#endif  // PLATFORM_HOST_PICO_RAND_H
@@ -0,0 +1,21 @@
+#ifndef PLATFORM_HOST_PICO_STDLIB_H
+#define PLATFORM_HOST_PICO_STDLIB_H
+
+// Host stand-in for the Pico SDK's pico/stdlib.h. See hal.hpp.
+
+#include <chrono>
+
+#include "../hal.hpp"
+#include "../hardware/gpio.h"
+
+#define __unused __attribute__((unused))
+
+inline void stdio_init_all() {}
+
+inline uint64_t time_us_64() {
+  return std::chrono::duration_cast<std::chrono::microseconds>(
+           std::chrono::steady_clock::now().time_since_epoch())
+    .count();
+}
+
+#endif  // PLATFORM_HOST_PICO_STDLIB_H
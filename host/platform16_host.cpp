@@ -0,0 +1,73 @@
+/*
+Builds all three instruments against the stand-in HAL in hal/ and renders a
+few seconds of each with every knob in the middle, reporting how long that
+took per sample. A quick smoke test that the firmware still compiles and runs
+off the board. Built with -DPLATFORM16_PROFILE=ON it also prints the profile of
+each (see lib/profile.hpp).
+
+usage: platform16_host [seconds]
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <chrono>
+#include <vector>
+
+#include "runner.hpp"
+
+using namespace platform;
+
+const float sampleRate = 24000.f;
+
+template<typename Instrument>
+void run(const char* name, float seconds) {
+  host::Board board;
+  board.init();
+  for (uint i = 1; i <= 16; i++) {
+    board.setKnob(i, 0.5f);
+  }
+
+  host::Runner<Instrument> runner(sampleRate);
+  runner.init();
+
+  uint numBuffers = (uint)(seconds * sampleRate) / host::samplesPerBuffer;
+  std::vector<int16_t> samples(host::samplesPerBuffer);
+  int peak = 0;
+
+  auto start = std::chrono::steady_clock::now();
+  for (uint b = 0; b < numBuffers; b++) {
+    runner.renderBuffer(samples.data(), host::samplesPerBuffer);
+    for (auto sample : samples) {
+      peak = std::max(peak, abs(sample));
+    }
+  }
+  auto end = std::chrono::steady_clock::now();
+
+  double ns = std::chrono::duration<double, std::nano>(end - start).count();
+  uint64_t numSamples = (uint64_t)numBuffers * host::samplesPerBuffer;
+  fprintf(stderr,
+          "%s: %llu samples, %.1f ns/sample, %.0fx realtime, peak %d, %zu clock out edges\n",
+          name,
+          (unsigned long long)numSamples,
+          ns / numSamples,
+          (numSamples / sampleRate) / (ns / 1e9),
+          peak,
+          board.getClockOutEdges().size());
+
+#ifdef PLATFORM_PROFILE
+  profiler.table.print();
+  profiler.table.reset();
+#endif
+}
+
+int main(int argc, char** argv) {
+  startProfileTime();
+  float seconds = argc > 1 ? atof(argv[1]) : 10.f;
+
+  run<TEPInstrument>("tep", seconds);
+  run<SDSInstrument>("sds", seconds);
+  run<PMDInstrument>("pmd", seconds);
+
+  return 0;
+}
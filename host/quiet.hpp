@@ -0,0 +1,41 @@
+#ifndef PLATFORM_HOST_QUIET_H
+#define PLATFORM_HOST_QUIET_H
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <unistd.h>
+
+namespace host {
+
+/*
+The firmwares printf debug output over USB serial. On the host that ends up on
+stdout, so this points stdout at /dev/null for as long as it is in scope to
+keep that chatter out of reports and out of the timings.
+*/
+struct QuietStdout {
+  QuietStdout(bool enabled = true) : saved{-1} {
+    if (!enabled) {
+      return;
+    }
+    fflush(stdout);
+    saved = dup(STDOUT_FILENO);
+    int devNull = open("/dev/null", O_WRONLY);
+    dup2(devNull, STDOUT_FILENO);
+    close(devNull);
+  }
+
+  ~QuietStdout() {
+    if (saved < 0) {
+      return;
+    }
+    fflush(stdout);
+    dup2(saved, STDOUT_FILENO);
+    close(saved);
+  }
+
+  int saved;
+};
+
+}  // namespace host
+
+#endif  // PLATFORM_HOST_QUIET_H
@@ -0,0 +1,144 @@
+/*
+Renders a firmware to a 16 bit mono wav file, driving the instrument exactly
+like the main loop in platform16.cpp does but against the stand-in HAL so that
+knobs and the clock input can be automated with a script (see script.hpp).
+
+usage: platform16_render <tep|sds|pmd> [options]
+  -r <rate>       sample rate (default 24000)
+  -d <seconds>    duration (default 10)
+  -s <script>     knob and clock automation script
+  -o <file>       output wav file (default <firmware>.wav)
+  -c <file>       write the clock out edges to a csv file (renders one sample
+                  at a time so the edges are sample accurate)
+  --seed <n>      seed for the random number generators (default 1)
+  -v              don't hide the firmware's printf output
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <chrono>
+#include <string>
+#include <vector>
+
+#include "render.hpp"
+#include "wav.hpp"
+
+struct RenderOptions {
+  std::string firmware;
+  float sampleRate = 24000.f;
+  float seconds = 10.f;
+  std::string scriptPath;
+  std::string outputPath;
+  std::string clockOutPath;
+  uint32_t seed = 1;
+  bool verbose = false;
+};
+
+void usage() {
+  fprintf(stderr,
+          "usage: platform16_render <tep|sds|pmd> [-r rate] [-d seconds] [-s script] [-o out.wav]\n"
+          "                         [-c clockout.csv] [--seed n] [-v]\n");
+}
+
+bool writeClockOut(const char* path, const std::vector<host::PinEdge>& edges, float sampleRate) {
+  FILE* file = fopen(path, "w");
+  if (!file) {
+    return false;
+  }
+  fprintf(file, "sample,seconds,value\n");
+  for (auto& edge : edges) {
+    fprintf(file,
+            "%llu,%.6f,%d\n",
+            (unsigned long long)edge.sample,
+            edge.sample / sampleRate,
+            edge.value ? 1 : 0);
+  }
+  fclose(file);
+  return true;
+}
+
+int render(const RenderOptions& options, const host::Script& script) {
+  host::RenderSettings settings;
+  settings.sampleRate = options.sampleRate;
+  settings.numSamples = (uint64_t)(options.seconds * options.sampleRate);
+  settings.seed = options.seed;
+  settings.verbose = options.verbose;
+  settings.sampleAccurate = !options.clockOutPath.empty();
+
+  host::Board board;
+  std::vector<int16_t> samples;
+
+  auto start = std::chrono::steady_clock::now();
+  if (!host::renderFirmware(options.firmware, script, settings, board, samples)) {
+    fprintf(stderr, "unknown firmware %s\n", options.firmware.c_str());
+    usage();
+    return 1;
+  }
+  auto end = std::chrono::steady_clock::now();
+
+  if (!host::writeWav(options.outputPath.c_str(), samples, (uint32_t)options.sampleRate)) {
+    fprintf(stderr, "%s: can't write wav file\n", options.outputPath.c_str());
+    return 1;
+  }
+  if (!options.clockOutPath.empty() &&
+      !writeClockOut(options.clockOutPath.c_str(), board.getClockOutEdges(), options.sampleRate)) {
+    fprintf(stderr, "%s: can't write clock out file\n", options.clockOutPath.c_str());
+    return 1;
+  }
+
+  double seconds = std::chrono::duration<double>(end - start).count();
+  fprintf(stderr,
+          "%s: rendered %.1fs in %.2fs (%.0fx realtime, %.1f ns/sample)\n",
+          options.outputPath.c_str(),
+          options.seconds,
+          seconds,
+          options.seconds / seconds,
+          seconds * 1e9 / settings.numSamples);
+  return 0;
+}
+
+int main(int argc, char** argv) {
+  RenderOptions options;
+
+  for (int i = 1; i < argc; i++) {
+    const char* arg = argv[i];
+    bool hasValue = i + 1 < argc;
+    if (strcmp(arg, "-r") == 0 && hasValue) {
+      options.sampleRate = atof(argv[++i]);
+    } else if (strcmp(arg, "-d") == 0 && hasValue) {
+      options.seconds = atof(argv[++i]);
+    } else if (strcmp(arg, "-s") == 0 && hasValue) {
+      options.scriptPath = argv[++i];
+    } else if (strcmp(arg, "-o") == 0 && hasValue) {
+      options.outputPath = argv[++i];
+    } else if (strcmp(arg, "-c") == 0 && hasValue) {
+      options.clockOutPath = argv[++i];
+    } else if (strcmp(arg, "--seed") == 0 && hasValue) {
+      options.seed = strtoul(argv[++i], nullptr, 0);
+    } else if (strcmp(arg, "-v") == 0) {
+      options.verbose = true;
+    } else if (arg[0] != '-' && options.firmware.empty()) {
+      options.firmware = arg;
+    } else {
+      usage();
+      return 1;
+    }
+  }
+
+  if (options.firmware.empty() || options.sampleRate <= 0.f || options.seconds <= 0.f) {
+    usage();
+    return 1;
+  }
+  if (options.outputPath.empty()) {
+    options.outputPath = options.firmware + ".wav";
+  }
+
+  host::Script script;
+  if (!options.scriptPath.empty() && !script.load(options.scriptPath.c_str())) {
+    return 1;
+  }
+
+  return render(options, script);
+}
@@ -0,0 +1,78 @@
+#ifndef PLATFORM_HOST_RENDER_H
+#define PLATFORM_HOST_RENDER_H
+
+#include <string>
+#include <vector>
+
+#include "quiet.hpp"
+#include "runner.hpp"
+#include "script.hpp"
+
+namespace host {
+
+struct RenderSettings {
+  float sampleRate = 24000.f;
+  uint64_t numSamples = 0;
+  // seeds every random number generator the firmwares use (see seedRandom())
+  uint32_t seed = 1;
+  // let the firmware's printf output through
+  bool verbose = false;
+  // Render one sample at a time so that clock out edges get timed to the
+  // sample instead of to the start of the block they happened in. The audio is
+  // the same either way.
+  bool sampleAccurate = false;
+};
+
+/*
+Renders numSamples of an instrument into samples while playing script into
+board. Everything is set up from scratch (board, random seeds, instrument) so
+the same settings and script always produce the same output.
+*/
+template<typename Instrument>
+void renderScript(const Script& script,
+                  const RenderSettings& settings,
+                  Board& board,
+                  std::vector<int16_t>& samples) {
+  board.init();
+  ScriptPlayer player(script, board, settings.sampleRate);
+  player.applyDue();
+
+  seedRandom(settings.seed);
+
+  samples.resize((settings.numSamples + samplesPerBuffer - 1) / samplesPerBuffer *
+                 samplesPerBuffer);
+  {
+    QuietStdout quiet(!settings.verbose);
+    Runner<Instrument> runner(settings.sampleRate);
+    runner.init();
+
+    for (size_t offset = 0; offset < samples.size(); offset += samplesPerBuffer) {
+      runner.renderBuffer(&samples[offset], samplesPerBuffer, [&](uint, uint remaining) {
+        return player.processSpan(settings.sampleAccurate ? 1 : remaining);
+      });
+    }
+  }
+  samples.resize(settings.numSamples);
+}
+
+// renders a firmware by name (tep, sds or pmd), returns false if there's no such firmware
+inline bool renderFirmware(const std::string& firmware,
+                           const Script& script,
+                           const RenderSettings& settings,
+                           Board& board,
+                           std::vector<int16_t>& samples) {
+  if (firmware == "tep") {
+    renderScript<platform::TEPInstrument>(script, settings, board, samples);
+  } else if (firmware == "sds") {
+    renderScript<platform::SDSInstrument>(script, settings, board, samples);
+  } else if (firmware == "pmd") {
+    renderScript<platform::PMDInstrument>(script, settings, board, samples);
+  } else {
+    return false;
+  }
+  return true;
+}
+
+}  // namespace host
+
+#endif  // PLATFORM_HOST_RENDER_H
@@ -0,0 +1,102 @@
+#ifndef PLATFORM_HOST_RUNNER_H
+#define PLATFORM_HOST_RUNNER_H
+
+#include "board.hpp"
+#include "pico/rand.h"
+
+namespace host {
+// platform16.cpp fixes this at compile time, the host tools pick it at runtime
+inline float halfSampleRate = 12000.f;
+}  // namespace host
+
+#ifndef HALF_SAMPLE_RATE
+#define HALF_SAMPLE_RATE (host::halfSampleRate)
+#endif
+
+#include "../lib/allocguard.hpp"
+#include "../lib/buttons.hpp"
+#include "../lib/fixed.hpp"
+#include "../lib/gpio.hpp"
+#include "../lib/pots.hpp"
+#include "../firmware/pmd/pmd-instrument.hpp"
+#include "../firmware/sds/sds-instrument.hpp"
+#include "../firmware/tep/tep-instrument.hpp"
+
+namespace host {
+
+// Same as in platform16.cpp
+const uint samplesPerBuffer = 256;
+
+// The instruments seed their generators (see lib/random.hpp) from
+// get_rand_32() in init(). This makes that start from a known seed so renders
+// are reproducible.
+inline void seedRandom(uint64_t seed) {
+  hal.seedRand(seed);
+}
+
+/*
+Drives an instrument the same way the main loop in platform16.cpp does: read
+the pots, update the instrument, tick the boot button for every sample in the
+block and then render it.
+*/
+template<typename Instrument>
+struct Runner {
+  Runner(float sampleRateIn)
+    : sampleRate{sampleRateIn},
+      pots(S0_PIN, S1_PIN, S2_PIN, S3_PIN),
+      instrument(pots, bootButton) {}
+
+  // the board has to be set up (knobs, clock jack) before this gets called
+  // because the pots get read and the instrument gets initialised from it
+  void init() {
+    halfSampleRate = sampleRate / 2.f;
+    pots.init();
+    instrument.init(sampleRate);
+  }
+
+  /*
+  Renders one buffer of up to samplesPerBuffer samples. nextSpan gets called
+  with the index of the next sample and the number of samples left and returns
+  how many samples the instrument can render in one go before it has to be
+  called again. That gives the caller a chance to change the clock inputs with
+  sample accuracy. Splitting a buffer doesn't change the output because
+  instruments only update from the pots between buffers.
+  */
+  template<typename Callback>
+  void renderBuffer(int16_t* samples, uint count, Callback&& nextSpan) {
+    pots.process();
+    instrument.update();
+    platform::updateBootButton(bootButton, count);
+
+    uint offset = 0;
+    while (offset < count) {
+      uint span = nextSpan(offset, count - offset);
+      {
+        NO_ALLOC_SCOPE();
+        instrument.processBlock(&block[offset], span);
+      }
+      // the first span sees the button's events, like the one block on the board
+      bootButton.clearEvents();
+      hal.advance(span);
+      offset += span;
+    }
+
+    for (uint i = 0; i < count; i++) {
+      samples[i] = platform::floatToSample16(block[i]);
+    }
+  }
+
+  void renderBuffer(int16_t* samples, uint count) {
+    renderBuffer(samples, count, [](uint, uint remaining) { return remaining; });
+  }
+
+  float sampleRate;
+  platform::Pots pots;
+  platform::ButtonInput bootButton;
+  Instrument instrument;
+  float block[samplesPerBuffer];
+};
+
+}  // namespace host
+
+#endif  // PLATFORM_HOST_RUNNER_H
@@ -0,0 +1,276 @@
+#ifndef PLATFORM_HOST_SCRIPT_H
+#define PLATFORM_HOST_SCRIPT_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include "board.hpp"
+
+namespace host {
+
+/*
+Knob and clock automation for the host tools. A script is a text file with
+one event per line, sorted or not. Everything after a # is a comment.
+
+  # seconds  command   arguments
+  0          K1        0.5           # set K1 (K1 to K16) to 0.5
+  2          K3        1 1.5         # ramp K3 to 1 over 1.5 seconds
+  0          jack      in            # plug a cable into clock in ("out" to unplug)
+  0          pulses    120           # clock in pulses on every 8th note at 120 BPM
+  8          pulses    0             # stop the pulses
+  9          pulse                   # a single clock in pulse
+
+Clock in pulses follow the teenage engineering convention used by the
+firmwares: one pulse every second 16th note.
+*/
+
+enum class ScriptCommand { KNOB, JACK, PULSES, PULSE };
+
+struct ScriptEvent {
+  float time;
+  ScriptCommand command;
+  uint knob;
+  float value;
+  float duration;
+};
+
+// how long the clock in stays high for each pulse
+const float pulseWidthSeconds = 0.005f;
+
+struct Script {
+  std::vector<ScriptEvent> events;
+
+  void add(ScriptEvent event) {
+    events.push_back(event);
+    std::stable_sort(events.begin(),
+                     events.end(),
+                     [](const ScriptEvent& a, const ScriptEvent& b) { return a.time < b.time; });
+  }
+
+  void setKnob(float time, uint knob, float value, float duration = 0.f) {
+    add({time, ScriptCommand::KNOB, knob, value, duration});
+  }
+
+  void setJack(float time, bool connected) {
+    add({time, ScriptCommand::JACK, 0, connected ? 1.f : 0.f, 0.f});
+  }
+
+  void setPulses(float time, float bpm) {
+    add({time, ScriptCommand::PULSES, 0, bpm, 0.f});
+  }
+
+  void pulse(float time) {
+    add({time, ScriptCommand::PULSE, 0, 0.f, 0.f});
+  }
+
+  // parses one line, returns false and fills in error if it doesn't make sense
+  bool parseLine(const char* lineIn, std::string& error) {
+    std::string line = lineIn;
+    line = line.substr(0, line.find('#'));
+
+    char command[32];
+    float time, a = 0.f, b = 0.f;
+    int count = sscanf(line.c_str(), "%f %31s %f %f", &time, command, &a, &b);
+    if (count <= 0) {
+      // blank line or comment
+      return true;
+    }
+    if (count < 2 || time < 0.f) {
+      error = "expected a time and a command";
+      return false;
+    }
+
+    if ((command[0] == 'K' || command[0] == 'k') && command[1]) {
+      int knob = atoi(command + 1);
+      if (knob < 1 || knob > 16 || count < 3) {
+        error = "expected K1 to K16 followed by a value";
+        return false;
+      }
+      setKnob(time, knob, a, count > 3 ? b : 0.f);
+    } else if (strcmp(command, "jack") == 0) {
+      char state[8];
+      if (sscanf(line.c_str(), "%*f %*s %7s", state) != 1 ||
+          (strcmp(state, "in") != 0 && strcmp(state, "out") != 0)) {
+        error = "expected jack in or jack out";
+        return false;
+      }
+      setJack(time, strcmp(state, "in") == 0);
+    } else if (strcmp(command, "pulses") == 0) {
+      if (count < 3 || a < 0.f) {
+        error = "expected pulses followed by a BPM";
+        return false;
+      }
+      setPulses(time, a);
+    } else if (strcmp(command, "pulse") == 0) {
+      pulse(time);
+    } else {
+      error = std::string("unknown command ") + command;
+      return false;
+    }
+    return true;
+  }
+
+  bool load(const char* path) {
+    FILE* file = fopen(path, "r");
+    if (!file) {
+      fprintf(stderr, "%s: can't open script\n", path);
+      return false;
+    }
+
+    char line[256];
+    int lineNumber = 0;
+    bool ok = true;
+    while (ok && fgets(line, sizeof(line), file)) {
+      lineNumber++;
+      std::string error;
+      if (!parseLine(line, error)) {
+        fprintf(stderr, "%s:%d: %s\n", path, lineNumber, error.c_str());
+        ok = false;
+      }
+    }
+    fclose(file);
+    return ok;
+  }
+};
+
+/*
+Plays a script into a Board. Call process() once per sample before the
+instrument processes that sample, or processSpan() before the instrument
+renders a block.
+*/
+struct ScriptPlayer {
+  ScriptPlayer(const Script& scriptIn, Board& boardIn, float sampleRateIn)
+    : script{scriptIn},
+      board{boardIn},
+      sampleRate{sampleRateIn},
+      nextEvent{0},
+      sample{0},
+      pulseInterval{0},
+      nextPulse{0},
+      pulseOff{0},
+      pulseHigh{false} {
+    for (uint i = 0; i < 16; i++) {
+      knobValues[i] = 0.f;
+      knobIncrements[i] = 0.f;
+      knobRampRemaining[i] = 0;
+    }
+  }
+
+  // applies every event that is due by now. Call this once before the
+  // instrument gets initialised so it starts with the knobs at time 0.
+  void applyDue() {
+    while (nextEvent < script.events.size() &&
+           (uint64_t)(script.events[nextEvent].time * sampleRate) <= sample) {
+      apply(script.events[nextEvent]);
+      nextEvent++;
+    }
+  }
+
+  void process() {
+    applyDue();
+
+    for (uint i = 0; i < 16; i++) {
+      if (knobRampRemaining[i]) {
+        knobRampRemaining[i]--;
+        knobValues[i] += knobIncrements[i];
+        board.setKnob(i + 1, knobValues[i]);
+      }
+    }
+
+    if (pulseHigh && sample >= pulseOff) {
+      pulseHigh = false;
+      board.setClockIn(false);
+    }
+    if (pulseInterval && sample >= nextPulse) {
+      startPulse();
+      nextPulse += pulseInterval;
+    }
+
+    sample++;
+  }
+
+  /*
+  Plays the next sample and then as many of the following ones as it can
+  without changing the clock input or jack which the instrument reads while it
+  renders. Returns how many samples were played, which is how many samples the
+  instrument can render in one block. Knobs don't need to split blocks because
+  the pots only get read between blocks.
+  */
+  uint processSpan(uint maxCount) {
+    process();
+    uint count = 1;
+    while (count < maxCount && !isChangeDue()) {
+      process();
+      count++;
+    }
+    return count;
+  }
+
+  // whether process() would apply an event or change the clock input
+  bool isChangeDue() {
+    if (nextEvent < script.events.size() &&
+        (uint64_t)(script.events[nextEvent].time * sampleRate) <= sample) {
+      return true;
+    }
+    return (pulseHigh && sample >= pulseOff) || (pulseInterval && sample >= nextPulse);
+  }
+
+  void apply(const ScriptEvent& event) {
+    switch (event.command) {
+      case ScriptCommand::KNOB: {
+        uint i = event.knob - 1;
+        uint rampSamples = (uint)(event.duration * sampleRate);
+        if (rampSamples) {
+          knobIncrements[i] = (event.value - knobValues[i]) / rampSamples;
+          knobRampRemaining[i] = rampSamples;
+        } else {
+          knobValues[i] = event.value;
+          knobRampRemaining[i] = 0;
+          board.setKnob(event.knob, event.value);
+        }
+        break;
+      }
+      case ScriptCommand::JACK:
+        board.setClockConnected(event.value > 0.f);
+        break;
+      case ScriptCommand::PULSES:
+        // two pulses per beat
+        pulseInterval = event.value > 0.f ? (uint64_t)(sampleRate * 30.f / event.value) : 0;
+        nextPulse = sample;
+        break;
+      case ScriptCommand::PULSE:
+        startPulse();
+        break;
+    }
+  }
+
+  void startPulse() {
+    pulseHigh = true;
+    pulseOff = sample + std::max<uint64_t>(1, (uint64_t)(pulseWidthSeconds * sampleRate));
+    board.setClockIn(true);
+  }
+
+  const Script& script;
+  Board& board;
+  float sampleRate;
+  size_t nextEvent;
+  uint64_t sample;
+
+  float knobValues[16];
+  float knobIncrements[16];
+  uint knobRampRemaining[16];
+
+  uint64_t pulseInterval;
+  uint64_t nextPulse;
+  uint64_t pulseOff;
+  bool pulseHigh;
+};
+
+}  // namespace host
+
+#endif  // PLATFORM_HOST_SCRIPT_H
@@ -0,0 +1,122 @@
+#ifndef PLATFORM_HOST_WAV_H
+#define PLATFORM_HOST_WAV_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <vector>
+
+namespace host {
+
+inline void writeLE16(FILE* file, uint16_t value) {
+  uint8_t bytes[2] = {(uint8_t)(value & 0xff), (uint8_t)(value >> 8)};
+  fwrite(bytes, 1, 2, file);
+}
+
+inline void writeLE32(FILE* file, uint32_t value) {
+  uint8_t bytes[4] = {(uint8_t)(value & 0xff),
+                      (uint8_t)((value >> 8) & 0xff),
+                      (uint8_t)((value >> 16) & 0xff),
+                      (uint8_t)(value >> 24)};
+  fwrite(bytes, 1, 4, file);
+}
+
+// writes a mono 16 bit PCM wav file, returns false if the file can't be written
+inline bool writeWav(const char* path, const std::vector<int16_t>& samples, uint32_t sampleRate) {
+  FILE* file = fopen(path, "wb");
+  if (!file) {
+    return false;
+  }
+
+  uint32_t dataSize = samples.size() * 2;
+
+  fwrite("RIFF", 1, 4, file);
+  writeLE32(file, 36 + dataSize);
+  fwrite("WAVE", 1, 4, file);
+
+  fwrite("fmt ", 1, 4, file);
+  writeLE32(file, 16);
+  writeLE16(file, 1);  // PCM
+  writeLE16(file, 1);  // mono
+  writeLE32(file, sampleRate);
+  writeLE32(file, sampleRate * 2);  // byte rate
+  writeLE16(file, 2);               // block align
+  writeLE16(file, 16);              // bits per sample
+
+  fwrite("data", 1, 4, file);
+  writeLE32(file, dataSize);
+  for (auto sample : samples) {
+    writeLE16(file, (uint16_t)sample);
+  }
+
+  bool ok = !ferror(file);
+  fclose(file);
+  return ok;
+}
+
+inline bool readBytes(FILE* file, uint8_t* bytes, size_t count) {
+  return fread(bytes, 1, count, file) == count;
+}
+
+inline uint32_t fromLE32(const uint8_t* bytes) {
+  return bytes[0] | (bytes[1] << 8) | (bytes[2] << 16) | ((uint32_t)bytes[3] << 24);
+}
+
+inline uint16_t fromLE16(const uint8_t* bytes) {
+  return bytes[0] | (bytes[1] << 8);
+}
+
+/*
+Reads a mono 16 bit PCM wav file like the ones writeWav() writes. Returns false
+if the file can't be read or is in some other format.
+*/
+inline bool readWav(const char* path, std::vector<int16_t>& samples, uint32_t& sampleRate) {
+  FILE* file = fopen(path, "rb");
+  if (!file) {
+    return false;
+  }
+
+  uint8_t header[12];
+  bool ok = readBytes(file, header, 12) && memcmp(header, "RIFF", 4) == 0 &&
+    memcmp(header + 8, "WAVE", 4) == 0;
+  bool hasFormat = false;
+
+  while (ok) {
+    uint8_t chunk[8];
+    if (!readBytes(file, chunk, 8)) {
+      ok = false;
+      break;
+    }
+    uint32_t size = fromLE32(chunk + 4);
+
+    if (memcmp(chunk, "fmt ", 4) == 0) {
+      uint8_t format[16];
+      ok = size >= 16 && readBytes(file, format, 16);
+      // PCM, mono, 16 bit
+      ok = ok && fromLE16(format) == 1 && fromLE16(format + 2) == 1 && fromLE16(format + 14) == 16;
+      sampleRate = fromLE32(format + 4);
+      hasFormat = true;
+      if (ok && size > 16) {
+        fseek(file, size - 16, SEEK_CUR);
+      }
+    } else if (memcmp(chunk, "data", 4) == 0) {
+      std::vector<uint8_t> data(size);
+      ok = hasFormat && readBytes(file, data.data(), size);
+      samples.resize(size / 2);
+      for (size_t i = 0; ok && i < samples.size(); i++) {
+        samples[i] = (int16_t)fromLE16(&data[i * 2]);
+      }
+      break;
+    } else {
+      fseek(file, size + (size & 1), SEEK_CUR);
+    }
+  }
+
+  fclose(file);
+  return ok;
+}
+
+}  // namespace host
+
+#endif  // PLATFORM_HOST_WAV_H
@@ -0,0 +1,176 @@
+#ifndef PLATFORM_ALLOCGUARD_H
+#define PLATFORM_ALLOCGUARD_H
+
+#include <errno.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/types.h>
+
+#if defined(PLATFORM_ALLOC_GUARD) && defined(PICO_RP2350)
+#include <reent.h>
+#include <sys/lock.h>
+
+#include "pico/platform.h"
+#endif
+
+/*
+Catches heap use in the audio path, which takes an unbounded amount of time
+and fragments the heap of a part with 520KB of RAM:
+
+  NO_ALLOC_SCOPE();
+  instrument.processBlock(block, size);
+
+Anything inside the scope on the same core that goes to the heap (malloc(),
+free() and friends, and so new, std::vector, std::function, and newlib's
+printf() for floats) panics on the board and aborts on the host. Scopes can
+nest, and ALLOW_ALLOC_SCOPE() lifts it again inside one, for things that only
+happen on the host.
+
+Only compiled in when PLATFORM_ALLOC_GUARD is defined (the
+PLATFORM16_ALLOC_GUARD cmake option, and always for platform16_golden),
+otherwise both macros are nothing at all. It hooks the heap once per program,
+and every program here is a single translation unit that includes this once:
+- on the board through newlib's __malloc_lock(), which every malloc(), free()
+  and realloc() takes, including the ones the C library makes itself (the
+  Pico SDK's own malloc wrappers end up there too). It doesn't know the size.
+- on the host by interposing glibc's malloc() and friends, which call through
+  to glibc's own (__libc_malloc() etc.).
+*/
+
+namespace platform {
+
+#ifdef PLATFORM_ALLOC_GUARD
+// The audio path can be on the other core to the controller (see
+// PLATFORM16_MULTICORE in platform16.cpp), which is free to allocate. Each core
+// only ever touches its own depth.
+inline uint noAllocDepths[2];
+
+inline uint getAllocGuardCore() {
+#ifdef PICO_RP2350
+  return get_core_num();
+#else
+  return 0;
+#endif
+}
+
+inline void checkAllocation(const char* what, size_t size) {
+  uint core = getAllocGuardCore();
+  if (!noAllocDepths[core]) {
+    return;
+  }
+  // reporting it can allocate too
+  noAllocDepths[core] = 0;
+#ifdef PICO_RP2350
+  (void)size;
+  panic("%s in the audio path", what);
+#else
+  fprintf(stderr, "%s of %zu bytes in the audio path\n", what, size);
+  abort();
+#endif
+}
+
+struct NoAllocScope {
+  NoAllocScope() : core{getAllocGuardCore()}, depth{noAllocDepths[core]} {
+    noAllocDepths[core] = depth + 1;
+  }
+
+  ~NoAllocScope() {
+    noAllocDepths[core] = depth;
+  }
+
+  uint core;
+  uint depth;
+};
+
+struct AllowAllocScope {
+  AllowAllocScope() : core{getAllocGuardCore()}, depth{noAllocDepths[core]} {
+    noAllocDepths[core] = 0;
+  }
+
+  ~AllowAllocScope() {
+    noAllocDepths[core] = depth;
+  }
+
+  uint core;
+  uint depth;
+};
+#endif
+
+}  // namespace platform
+
+#define ALLOC_GUARD_CONCAT_(a, b) a##b
+#define ALLOC_GUARD_CONCAT(a, b) ALLOC_GUARD_CONCAT_(a, b)
+
+#ifdef PLATFORM_ALLOC_GUARD
+#define NO_ALLOC_SCOPE() platform::NoAllocScope ALLOC_GUARD_CONCAT(noAllocScope, __LINE__)
+#define ALLOW_ALLOC_SCOPE() platform::AllowAllocScope ALLOC_GUARD_CONCAT(allowAllocScope, __LINE__)
+
+#ifdef PICO_RP2350
+// These replace newlib's (libc/stdlib/mlock.c), taking the same lock.
+extern "C" {
+#ifndef __SINGLE_THREAD__
+__LOCK_INIT_RECURSIVE(static, __malloc_recursive_mutex);
+#endif
+
+void __malloc_lock(struct _reent*) {
+  platform::checkAllocation("heap use", 0);
+#ifndef __SINGLE_THREAD__
+  __lock_acquire_recursive(__malloc_recursive_mutex);
+#endif
+}
+
+void __malloc_unlock(struct _reent*) {
+#ifndef __SINGLE_THREAD__
+  __lock_release_recursive(__malloc_recursive_mutex);
+#endif
+}
+}
+#else
+extern "C" {
+void* __libc_malloc(size_t size);
+void* __libc_calloc(size_t count, size_t size);
+void* __libc_realloc(void* p, size_t size);
+void* __libc_memalign(size_t alignment, size_t size);
+void __libc_free(void* p);
+
+void* malloc(size_t size) {
+  platform::checkAllocation("malloc", size);
+  return __libc_malloc(size);
+}
+
+void* calloc(size_t count, size_t size) {
+  platform::checkAllocation("calloc", count * size);
+  return __libc_calloc(count, size);
+}
+
+void* realloc(void* p, size_t size) {
+  platform::checkAllocation("realloc", size);
+  return __libc_realloc(p, size);
+}
+
+void* aligned_alloc(size_t alignment, size_t size) {
+  platform::checkAllocation("aligned_alloc", size);
+  return __libc_memalign(alignment, size);
+}
+
+int posix_memalign(void** p, size_t alignment, size_t size) {
+  platform::checkAllocation("posix_memalign", size);
+  *p = __libc_memalign(alignment, size);
+  return *p ? 0 : ENOMEM;
+}
+
+void free(void* p) {
+  if (p) {
+    platform::checkAllocation("free", 0);
+  }
+  __libc_free(p);
+}
+}
+#endif
+#else
+#define NO_ALLOC_SCOPE()
+#define ALLOW_ALLOC_SCOPE()
+#endif
+
+#endif  // PLATFORM_ALLOCGUARD_H
@@ -2,8 +2,9 @@
 #ifndef PLATFORM_ARPEGGIO_H
 #define PLATFORM_ARPEGGIO_H
 
-#include <vector>
-#include <cstdlib>
+#include <algorithm>
+
+#include "random.hpp"
 
 namespace platform {
 
@@ -20,8 +21,17 @@ enum class ArpeggioMode {
   RANDOM            // random
 };
 
+// the most notes an arpeggio can have, they're kept in the object so setting
+// them doesn't allocate in the audio path
+const size_t maxArpeggioValues = 8;
+
 struct Arpeggio {
-  Arpeggio() : nextStep(0), direction(1), mode(ArpeggioMode::NO_ARPEGGIO), phase(0), lastValue(1.0f) {}
+  Arpeggio() : numValues(0), nextStep(0), direction(1), mode(ArpeggioMode::NO_ARPEGGIO), phase(0), lastValue(1.0f) {}
+
+  // for ArpeggioMode::RANDOM
+  void seed(uint64_t seed) {
+    random.seed(seed);
+  }
 
   void setMode(ArpeggioMode newMode) {
     if (newMode == mode) {
@@ -31,18 +41,21 @@ struct Arpeggio {
     reset();
   }
 
-  void setValues(const std::vector<float>& newValues) {
+  // anything past maxArpeggioValues gets left out
+  void setValues(const float* newValues, size_t count) {
+    count = std::min(count, maxArpeggioValues);
     // TODO: this is not the most efficient. We can probably just compare the noteIndex on the outside
-    if (newValues == values) {
+    if (count == numValues && std::equal(newValues, newValues + count, values)) {
       return;
     }
-    values = newValues;
+    std::copy(newValues, newValues + count, values);
+    numValues = count;
     reset();
   }
 
   void reset() {
     if (mode == ArpeggioMode::DOWN || mode == ArpeggioMode::DOWN_UP) {
-      nextStep = values.size() - 1;
+      nextStep = numValues - 1;
       direction = -1;
     } else {
       nextStep = 0; 
@@ -56,8 +69,8 @@ struct Arpeggio {
   }
 
   float process() {
-    // If the vector is empty, always return 1
-    if (values.empty()) {
+    // If there aren't any values, always return 1
+    if (!numValues) {
       lastValue = 1.0f;
       return lastValue;
     }
@@ -71,13 +84,13 @@ struct Arpeggio {
 
       case ArpeggioMode::UP:
         result = values[nextStep];
-        nextStep = (nextStep + 1) % values.size();
+        nextStep = (nextStep + 1) % numValues;
         break;
 
       case ArpeggioMode::DOWN:
         result = values[nextStep];
         if (nextStep == 0) {
-          nextStep = values.size() - 1;
+          nextStep = numValues - 1;
         } else {
           nextStep--;
         }
@@ -87,13 +100,13 @@ struct Arpeggio {
         result = values[nextStep];
         nextStep += direction;
         
-        if (nextStep >= values.size()) {
-          nextStep = values.size() - 2;
+        if (nextStep >= numValues) {
+          nextStep = numValues - 2;
           if (nextStep < 0) nextStep = 0;
           direction = -1;
         } else if (nextStep < 0) {
           nextStep = 1;
-          if (nextStep >= values.size()) nextStep = 0;
+          if (nextStep >= numValues) nextStep = 0;
           direction = 1;
         }
         break;
@@ -104,10 +117,10 @@ struct Arpeggio {
         
         if (nextStep < 0) {
           nextStep = 1;
-          if (nextStep >= values.size()) nextStep = 0;
+          if (nextStep >= numValues) nextStep = 0;
           direction = 1;
-        } else if (nextStep >= values.size()) {
-          nextStep = values.size() - 2;
+        } else if (nextStep >= numValues) {
+          nextStep = numValues - 2;
           if (nextStep < 0) nextStep = 0;
           direction = -1;
         }
@@ -116,7 +129,7 @@ struct Arpeggio {
       case ArpeggioMode::CONVERGE: {
         // Alternate between beginning and end, moving toward the middle
         int leftIndex = phase / 2;
-        int rightIndex = values.size() - 1 - (phase / 2);
+        int rightIndex = numValues - 1 - (phase / 2);
         
         if (phase % 2 == 0) {
           result = values[leftIndex];
@@ -125,7 +138,7 @@ struct Arpeggio {
         }
         
         phase++;
-        if (leftIndex >= rightIndex || phase >= values.size() * 2) {
+        if (leftIndex >= rightIndex || phase >= numValues * 2) {
           phase = 0;
         }
         break;
@@ -133,12 +146,12 @@ struct Arpeggio {
 
       case ArpeggioMode::DIVERGE: {
         // Start from middle, alternate outward
-        int mid = values.size() / 2;
+        int mid = numValues / 2;
         int offset = phase / 2;
         
         if (phase % 2 == 0) {
           nextStep = mid + offset;
-          if (nextStep >= values.size()) nextStep = values.size() - 1;
+          if (nextStep >= numValues) nextStep = numValues - 1;
         } else {
           nextStep = mid - offset - 1;
           if (nextStep < 0) nextStep = 0;
@@ -147,7 +160,7 @@ struct Arpeggio {
         result = values[nextStep];
         
         phase++;
-        if (phase >= values.size() * 2) {
+        if (phase >= numValues * 2) {
           phase = 0;
         }
         break;
@@ -155,12 +168,12 @@ struct Arpeggio {
 
       case ArpeggioMode::CONVERGE_DIVERGE: {
         // converge then diverge
-        int halfCycle = values.size();
+        int halfCycle = numValues;
         
         if (phase < halfCycle) {
           // converge phase
           int leftIndex = phase / 2;
-          int rightIndex = values.size() - 1 - (phase / 2);
+          int rightIndex = numValues - 1 - (phase / 2);
           
           if (phase % 2 == 0) {
             result = values[leftIndex];
@@ -170,12 +183,12 @@ struct Arpeggio {
         } else {
           // diverge phase
           int divergePhase = phase - halfCycle;
-          int mid = values.size() / 2;
+          int mid = numValues / 2;
           int offset = divergePhase / 2;
           
           if (divergePhase % 2 == 0) {
             nextStep = mid + offset;
-            if (nextStep >= values.size()) nextStep = values.size() - 1;
+            if (nextStep >= numValues) nextStep = numValues - 1;
           } else {
             nextStep = mid - offset - 1;
             if (nextStep < 0) nextStep = 0;
@@ -185,7 +198,7 @@ struct Arpeggio {
         }
         
         phase++;
-        if (phase >= values.size() * 2) {
+        if (phase >= numValues * 2) {
           phase = 0;
         }
         break;
@@ -193,16 +206,16 @@ struct Arpeggio {
 
       case ArpeggioMode::DIVERGE_CONVERGE: {
         // diverge then converge
-        int halfCycle = values.size();
+        int halfCycle = numValues;
         
         if (phase < halfCycle) {
           // diverge phase
-          int mid = values.size() / 2;
+          int mid = numValues / 2;
           int offset = phase / 2;
           
           if (phase % 2 == 0) {
             nextStep = mid + offset;
-            if (nextStep >= values.size()) nextStep = values.size() - 1;
+            if (nextStep >= numValues) nextStep = numValues - 1;
           } else {
             nextStep = mid - offset - 1;
             if (nextStep < 0) nextStep = 0;
@@ -213,7 +226,7 @@ struct Arpeggio {
           // converge phase
           int convergePhase = phase - halfCycle;
           int leftIndex = convergePhase / 2;
-          int rightIndex = values.size() - 1 - (convergePhase / 2);
+          int rightIndex = numValues - 1 - (convergePhase / 2);
           
           if (convergePhase % 2 == 0) {
             result = values[leftIndex];
@@ -223,14 +236,14 @@ struct Arpeggio {
         }
         
         phase++;
-        if (phase >= values.size() * 2) {
+        if (phase >= numValues * 2) {
           phase = 0;
         }
         break;
       }
 
       case ArpeggioMode::RANDOM:
-        nextStep = rand() % values.size();
+        nextStep = random.nextBelow(numValues);
         result = values[nextStep];
         break;
     }
@@ -240,12 +253,14 @@ struct Arpeggio {
   }
 
 private:
-  std::vector<float> values;
+  float values[maxArpeggioValues];
+  size_t numValues;
   int nextStep;
   int direction;
   ArpeggioMode mode;
   int phase;
   float lastValue;
+  Random random;
 };
 
 }  // namespace platform
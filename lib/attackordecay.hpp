@@ -1,5 +1,5 @@
 #ifndef PLATFORM_ATTACKORDECAY_H
-#define PLATFORM_ATTACKODECAY_H
+#define PLATFORM_ATTACKORDECAY_H
 
 #include <math.h>
 
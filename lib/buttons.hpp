@@ -27,13 +27,18 @@ const auto doubleTimeoutTicks = 12000;
 // How long a button has to be held down before it counts as a long press.
 const auto longTimeoutTicks = 24000;
 
+// The button gets updated once per sample, but a whole buffer's worth of
+// updates happen before the instrument renders that buffer. So the one-shot
+// events below stay set from the update that caught them until clearEvents(),
+// which gets called once the instrument has rendered the block, rather than
+// only lasting one update.
 struct ButtonInput {
   bool isDown;         // whether the button is currently being held down
-  bool isPressed;      // true once when the button is first pressed down
-  bool isReleased;     // true once when the button is first released
-  bool isSingle;       // true once when the button was quickly pressed and released
-  bool isDouble;       // true once when the button was quickly pressed and released twice
-  bool isLong;         // true once when the button has been held down a while
+  bool isPressed;      // set when the button is first pressed down
+  bool isReleased;     // set when the button is first released
+  bool isSingle;       // set when the button was quickly pressed and released
+  bool isDouble;       // set when the button was quickly pressed and released twice
+  bool isLong;         // set when the button has been held down a while
 
   int debounceTimeout; // a positive integer if we're debouncing (ie. ignoring changes)
   int singleTimeout;   // a positive integer to timeout a single-press
@@ -57,14 +62,16 @@ struct ButtonInput {
                   lastDoubleTimeout(0)
                  {}
 
-  void update(bool state) {
-    // clear all these booleans because they can only be true for one update
+  // the events have been seen, see above
+  void clearEvents() {
     isPressed = false;
     isReleased = false;
     isSingle = false;
     isDouble = false;
     isLong = false;
+  }
 
+  void update(bool state) {
     // timeout the debounce
     if (debounceTimeout) {
       debounceTimeout--;
@@ -142,6 +149,19 @@ struct ButtonInput {
     isDown = state;
   }
 };
+
+// One update per sample for the next count samples. Checking the boot button is
+// quite slow, so how frequently we check it is a compromise and unfortunately
+// that means we can miss quick presses.
+inline void updateBootButton(ButtonInput& bootButton, uint count) {
+  bool bootButtonState = false;
+  for (uint i = 0; i < count; i++) {
+    if (i % 16 == 0) {
+      bootButtonState = getBootButton();
+    }
+    bootButton.update(bootButtonState);
+  }
+}
 }  // namespace platform
 
 #endif // PLATFORM_BUTTONS_H
\ No newline at end of file
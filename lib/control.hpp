@@ -0,0 +1,110 @@
+#ifndef PLATFORM_CONTROL_H
+#define PLATFORM_CONTROL_H
+
+#include <sys/types.h>
+
+#include "fixed.hpp"
+
+namespace platform {
+
+/*
+Instruments split their work into audio rate (every sample) and control rate
+(once every CONTROL_BLOCK_SIZE samples). Each instrument declares its control
+rate parameters as a ControlTargets struct, one member per value that feeds
+into the audio. Its controlTick() works them out with getControlTargets() and
+rampTo() hands them to their ramps (LinearRamp, or the modules' own rampFreq()),
+which move linearly towards them over the following control block so they
+don't step (zipper noise). Modules that only ever run at control rate
+(LFOs, envelopes that only move a filter) get initialised with
+controlRate(sampleRate) and processed once per control block.
+
+8, 16 or 32 are sensible sizes. Bigger saves more work, but the control rate
+parameters lag behind by up to two control blocks.
+*/
+#ifndef CONTROL_BLOCK_SIZE
+#define CONTROL_BLOCK_SIZE 16
+#endif
+
+const float controlBlockRecip = 1.f / CONTROL_BLOCK_SIZE;
+
+inline float controlRate(float sampleRate) {
+  return sampleRate * controlBlockRecip;
+}
+
+// Counts samples to know when the next control block starts. The count carries
+// on across blocks so it doesn't matter how the audio gets split into blocks.
+struct ControlClock {
+  ControlClock() : samplesLeft{0} {}
+
+  // true on the first sample of every control block
+  bool process() {
+    if (samplesLeft) {
+      samplesLeft--;
+      return false;
+    }
+    samplesLeft = CONTROL_BLOCK_SIZE - 1;
+    return true;
+  }
+
+  // For rendering a control block at a time instead: whether the next sample
+  // starts a new control block
+  bool isDue() {
+    return samplesLeft == 0;
+  }
+
+  // Moves past the rest of the current control block (or all of a new one if
+  // one is due), but no more than maxCount samples. Returns how many samples
+  // that is.
+  uint processSpan(uint maxCount) {
+    if (!samplesLeft) {
+      samplesLeft = CONTROL_BLOCK_SIZE;
+    }
+    uint span = samplesLeft < maxCount ? samplesLeft : maxCount;
+    samplesLeft -= span;
+    return span;
+  }
+
+  uint samplesLeft;
+};
+
+// Ramps linearly from where it is to a new target over one control block.
+struct LinearRamp {
+  LinearRamp() : value{0.f}, increment{0.f} {}
+
+  void setTarget(float target) {
+    increment = (target - value) * controlBlockRecip;
+  }
+
+  // call once per sample, setTarget() has to be called every control block
+  float process() {
+    value += increment;
+    return value;
+  }
+
+  float value;
+  float increment;
+};
+
+// LinearRamp for fixed point values with fractionBits fraction bits (see
+// fixed.hpp). Lands within CONTROL_BLOCK_SIZE steps of the target, close enough
+// when it gets a new one every control block.
+template <int fractionBits>
+struct FixedLinearRamp {
+  FixedLinearRamp() : value{0}, increment{0} {}
+
+  void setTarget(float target) {
+    increment = (floatToFixed<fractionBits>(target) - value) / CONTROL_BLOCK_SIZE;
+  }
+
+  int32_t process() {
+    value += increment;
+    return value;
+  }
+
+  int32_t value;
+  int32_t increment;
+};
+
+}  // namespace platform
+
+#endif  // PLATFORM_CONTROL_H
@@ -0,0 +1,123 @@
+#ifndef PLATFORM_FIXED_H
+#define PLATFORM_FIXED_H
+
+#include <stdint.h>
+#include <sys/types.h>
+
+#if defined(__ARM_FEATURE_DSP) || defined(__ARM_FEATURE_SAT) || defined(__ARM_FEATURE_SIMD32)
+#include <arm_acle.h>
+#endif
+
+namespace platform {
+
+/*
+Fixed point helpers for the integer version of the voice chain (oscillator,
+ladder filter, overdrive and VCA), which instruments can pick at compile time
+instead of the float one. See FixedWavetableOscillator, FixedLadderFilter and
+FixedOverdrive.
+
+The chain's samples are Q27: 1.0 is 1 << 27, which leaves 4 bits of headroom
+(up to 16) for the sums of oscillators and the filter's resonance.
+Coefficients are mostly Q30. Multiplies go through 64 bits and get shifted
+back down, which is one smull on the M33 (and a call into the runtime on the
+M0+ of the RP2040, which doesn't have a 64 bit multiply).
+
+On cores with the DSP extension (the M33 of the RP2350) the saturating and the
+packed 2x16 ops are single instructions, anywhere else (the host, the M0+)
+they're plain C.
+*/
+using q15 = int16_t;
+using q27 = int32_t;
+using q31 = int32_t;
+
+const int q27Bits = 27;
+const q27 q27One = 1 << q27Bits;
+
+template <int fractionBits>
+constexpr int32_t floatToFixed(float value) {
+  return (int32_t)(value * (float)(1ll << fractionBits));
+}
+
+template <int fractionBits>
+constexpr float fixedToFloat(int32_t value) {
+  return value * (1.f / (float)(1ll << fractionBits));
+}
+
+inline q27 floatToQ27(float value) {
+  return floatToFixed<q27Bits>(value);
+}
+
+inline float q27ToFloat(q27 value) {
+  return fixedToFloat<q27Bits>(value);
+}
+
+// for code that works with either float or Q27 samples
+inline float sampleToFloat(float sample) {
+  return sample;
+}
+
+inline float sampleToFloat(q27 sample) {
+  return q27ToFloat(sample);
+}
+
+// clamps to a signed number of bits bits wide
+template <int bits>
+inline int32_t ssat(int32_t value) {
+#if defined(__ARM_FEATURE_SAT)
+  return __ssat(value, bits);
+#else
+  const int32_t max = (1 << (bits - 1)) - 1;
+  const int32_t min = -max - 1;
+  return value > max ? max : value < min ? min : value;
+#endif
+}
+
+// a + b, saturating instead of wrapping around
+inline int32_t qadd(int32_t a, int32_t b) {
+#if defined(__ARM_FEATURE_DSP)
+  return __qadd(a, b);
+#else
+  int64_t sum = (int64_t)a + b;
+  return sum > INT32_MAX ? INT32_MAX : sum < INT32_MIN ? INT32_MIN : (int32_t)sum;
+#endif
+}
+
+// (a * b) >> shift, for multiplying by a coefficient with shift fraction bits
+template <int shift>
+inline int32_t mulShift(int32_t a, int32_t b) {
+  return (int32_t)(((int64_t)a * b) >> shift);
+}
+
+// the same, but clamped to the int32_t range instead of wrapping around
+template <int shift>
+inline int32_t mulShiftSat(int32_t a, int32_t b) {
+  int64_t product = ((int64_t)a * b) >> shift;
+  return product > INT32_MAX ? INT32_MAX : product < INT32_MIN ? INT32_MIN : (int32_t)product;
+}
+
+// two Q15s in one word, low in the bottom half
+inline uint32_t packQ15(q15 low, q15 high) {
+  return (uint16_t)low | ((uint32_t)(uint16_t)high << 16);
+}
+
+// accumulator + the products of the bottom halves and of the top halves, the
+// dot product of two pairs of Q15s in one instruction on the M33
+inline int32_t smlad(uint32_t a, uint32_t b, int32_t accumulator) {
+#if defined(__ARM_FEATURE_SIMD32)
+  return (int32_t)__smlad(a, b, (uint32_t)accumulator);
+#else
+  return accumulator + (int16_t)a * (int16_t)b + (int16_t)(a >> 16) * (int16_t)(b >> 16);
+#endif
+}
+
+// -1 to 1 as a 16 bit sample for the audio output, clipped instead of wrapping
+// around if it's outside that
+inline int16_t floatToSample16(float value) {
+  // clamp first, converting floats that don't fit into an int32_t is undefined
+  value = value > 1.f ? 1.f : value < -1.f ? -1.f : value;
+  return (int16_t)ssat<16>((int32_t)(value * 32767.f));
+}
+
+}  // namespace platform
+
+#endif  // PLATFORM_FIXED_H
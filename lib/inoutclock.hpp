@@ -3,6 +3,7 @@
 
 #include "./gpio.hpp"
 #include "./metro.hpp"
+#include "./profile.hpp"
 
 namespace platform {
 
@@ -17,7 +18,7 @@ It then outputs a clock signal on the CLOCK_OUT_PIN at every second 16th note
 like teenage engineering devices do.
 */
 struct InOutClock {
-  InOutClock(Metro& clockIn): clock(clockIn), sampleRate(0), isExternalClock(false), externalClockTicks(0), clockTicks(0), samplesSinceLastClockTick(0), externalClockFrequency(0), previousClockState(false) {}
+  InOutClock(Metro& clockIn): clock(clockIn), sampleRate(0), isExternalClock(false), externalClockTicks(0), clockTicks(0), samplesSinceLastClockTick(0), externalClockFrequency(0), previousClockState(false), connectedChanged(false), tickFrequencyChanged(false) {}
   ~InOutClock() {}
 
   void init(float sampleRateIn) {
@@ -45,15 +46,24 @@ struct InOutClock {
     }
   }
 
+  // Checks whether something is plugged into the clock input. This only has to
+  // happen once per block while the clock input itself is read every sample.
+  void updateConnected() {
+    bool clockConnectedState = gpio_get(CLOCK_IN_CONNECTED_PIN);
+    connectedChanged = clockConnectedState != isExternalClock;
+    isExternalClock = clockConnectedState;
+  }
+
   bool process(float bpm) {
+    PROFILE_SCOPE("clock");
     samplesSinceLastClockTick++;
 
     bool tick = false;
+    tickFrequencyChanged = connectedChanged;
+    connectedChanged = false;
 
-    bool clockConnectedState = gpio_get(CLOCK_IN_CONNECTED_PIN);
-    if (clockConnectedState) {
+    if (isExternalClock) {
       // external clock
-      isExternalClock = true;
 
       // the pin is inverted because it is tied to an NPN transistor
       bool clockState = !gpio_get(CLOCK_IN_PIN);
@@ -98,12 +108,9 @@ struct InOutClock {
           // divider/multiplier is set to anyway)
 
           externalClockTicks++;
+          tickFrequencyChanged = true;
         }
       }
-    } else {
-      // internal clock
-
-      isExternalClock = false;
     }
 
     // either internal or external
@@ -126,6 +133,13 @@ struct InOutClock {
     return clockTicks;
   }
 
+  // Whether the last process() call changed what getTickFrequency() returns
+  // for the same bpm, ie. the clock got (dis)connected or an external tick
+  // arrived.
+  bool isTickFrequencyChanged() {
+    return tickFrequencyChanged;
+  }
+
   private:
   // isInternalClock, externalClockTicks, clockTicks, samplesSinceLastClockTick,
   // externalClockFrequency, previousClockState, previousClockState, clock, state
@@ -137,6 +151,8 @@ struct InOutClock {
   int samplesSinceLastClockTick;
   float externalClockFrequency;
   bool previousClockState;
+  bool connectedChanged;
+  bool tickFrequencyChanged;
 
 };
 
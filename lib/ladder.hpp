@@ -1,21 +1,17 @@
 #ifndef PLATFORM_LADDER_H
 #define PLATFORM_LADDER_H
 
-#include <array>
 #include <cmath>
 
+#include "control.hpp"
+#include "fixed.hpp"
+#include "profile.hpp"
+#include "resample.hpp"
+#include "saturation.hpp"
 #include "utils.hpp"
 
 namespace platform {
 
-static inline float fast_tanh(float x) {
-  if (x > 3.0f)
-    return 1.0f;
-  if (x < -3.0f)
-    return -1.0f;
-  float x2 = x * x;
-  return x * (27.0f + x2) / (27.0f + 9.0f * x2);
-}
 //-----------------------------------------------------------
 // Ported from daisysp:
 // Huovilainen New Moog (HNM) model as per CMJ jun 2006
@@ -32,15 +28,28 @@ static inline float fast_tanh(float x) {
 // please retain this header if you use this code.
 //-----------------------------------------------------------
 
+enum class LadderFilterMode { LP24, LP12, BP24, BP12, HP24, HP12 };
+
 /**
  * 4-pole ladder filter model with selectable filter type (LP/BP/HP 12 or 24 dB/oct),
  * drive, passband gain compensation, and stable self-oscillation.
  *
+ * oversampling is 1, 2 or 4. The filter is only accurate up to about 0.106 of
+ * the oversampled rate, so the cutoff gets limited to 0.425 of the sample rate
+ * at 4x, half that at 2x and a quarter at 1x, but the filter costs about half
+ * as much for every halving.
  *
+ * modes are the filter modes setFilterMode() can choose between, all of them
+ * if there are none. Only the listed modes get compiled, and with just one the
+ * mode doesn't get checked at all.
  */
+template <uint oversampling = 4, LadderFilterMode... modes>
 class LadderFilter {
+  static_assert(oversampling == 1 || oversampling == 2 || oversampling == 4,
+                "LadderFilter oversampling has to be 1, 2 or 4");
+
   public:
-  enum class FilterMode { LP24, LP12, BP24, BP12, HP24, HP12 };
+  using FilterMode = LadderFilterMode;
 
   LadderFilter() = default;
   ~LadderFilter() = default;
@@ -55,7 +64,8 @@ class LadderFilter {
     Fbase = 1000.0f;
     Qadjust = 1.0f;
     oldinput = 0.f;
-    mode = FilterMode::LP24;
+    rampSamplesLeft = 0;
+    mode = defaultMode();
 
     setPassbandGain(0.5f);
     setInputDrive(0.5f);
@@ -65,29 +75,18 @@ class LadderFilter {
 
   /** Process single sample */
   float process(float in) {
-    float input = in * driveScaled;
-    float total = 0.0f;
-    float interp = 0.0f;
-    for (size_t os = 0; os < interpolation; os++) {
-      float in_interp = (interp * oldinput + (1.0f - interp) * input);
-      float u = in_interp - (z1[3] - pbg * in_interp) * K * Qadjust;
-      u = fast_tanh(u);
-      float stage1 = LPF(u, 0);
-      float stage2 = LPF(stage1, 1);
-      float stage3 = LPF(stage2, 2);
-      float stage4 = LPF(stage3, 3);
-      total += weightedSumForCurrentMode({u, stage1, stage2, stage3, stage4}) * interpolationRecip;
-      interp += interpolationRecip;
-    }
-    oldinput = input;
-    return total;
+    PROFILE_SCOPE("filter");
+    dispatchMode([&]<FilterMode blockMode>() { processBlockForMode<blockMode>(&in, 1); });
+    return in;
   }
 
-  /** Process mono buffer/block of samples in place */
-  __attribute__((optimize("unroll-loops"))) void processBlock(float* buf, size_t size) {
-    for (size_t i = 0; i < size; i++) {
-      buf[i] = process(buf[i]);
-    }
+  /** Process mono buffer/block of samples in place. The mode stays the same
+   * for the whole block, so the stage mix gets picked once instead of every
+   * sample. A ramp started by rampFreq() carries on across the block.
+   */
+  void processBlock(float* buf, size_t size) {
+    PROFILE_SCOPE("filter");
+    dispatchMode([&]<FilterMode blockMode>() { processBlockForMode<blockMode>(buf, size); });
   }
 
   /**
@@ -97,9 +96,34 @@ class LadderFilter {
   */
   void setFreq(float freq) {
     Fbase = freq;
+    rampSamplesLeft = 0;
     computeCoeffs(freq);
   }
 
+  /**
+      Moves the cutoff frequency to freq over the next control block (see
+      control.hpp) by ramping the coefficients linearly. Much cheaper than
+      calling setFreq() every sample, but doesn't step like calling it once per
+      control block would.
+  */
+  void rampFreq(float freq) {
+    if (freq == Fbase) {
+      return;
+    }
+    Fbase = freq;
+
+    float fromAlpha = alpha;
+    float fromQadjust = Qadjust;
+    computeCoeffs(freq);
+    targetAlpha = alpha;
+    targetQadjust = Qadjust;
+    alphaIncrement = (targetAlpha - fromAlpha) * controlBlockRecip;
+    QadjustIncrement = (targetQadjust - fromQadjust) * controlBlockRecip;
+    alpha = fromAlpha;
+    Qadjust = fromQadjust;
+    rampSamplesLeft = CONTROL_BLOCK_SIZE;
+  }
+
   /**
       Sets the resonance of the filter.
       Filter will stably self oscillate at higher values.
@@ -119,8 +143,8 @@ class LadderFilter {
       Valid in range 0 - 0.5
       Internally clamped to this range.
    */
-  void setPassbandGain(float pbg) {
-    pbg = fclamp(pbg, 0.0f, 0.5f);
+  void setPassbandGain(float pbgIn) {
+    pbg = fclamp(pbgIn, 0.0f, 0.5f);
     setInputDrive(drive);
   }
 
@@ -138,16 +162,9 @@ class LadderFilter {
       driveScaled = drive;
     }
   }
-  float LPF(float s, int i) {
-    //             (1.0 / 1.3)   (0.3 / 1.3)
-    float ft = s * 0.76923077f + 0.23076923f * z0[i] - z1[i];
-    ft = ft * alpha + z1[i];
-    z1[i] = ft;
-    z0[i] = s;
-    return ft;
-  }
+
   void computeCoeffs(float freq) {
-    freq = fclamp(freq, 5.0f, sampleRate * 0.425f);
+    freq = fclamp(freq, 5.0f, sampleRate * maxCutoffRatio);
     float wc = freq * 2.0f * M_PI * srIntRecip;
     float wc2 = wc * wc;
     alpha = 0.9892f * wc - 0.4342f * wc2 + 0.1381f * wc * wc2 - 0.0202f * wc2 * wc2;
@@ -155,56 +172,380 @@ class LadderFilter {
     // revised hfQ (rvh - feb 14 2021)
   }
 
-  float weightedSumForCurrentMode(const std::array<float, 5>& stage_outs) {
-    // Weighted filter stage mixing to achieve selected response
-    // as described in "Oscillator and Filter Algorithms for Virtual Analog Synthesis"
-    // Välimäki and Huovilainen, Computer Music Journal, vol 60, 2006
-    switch (mode) {
-      case FilterMode::LP24:
-        return stage_outs[4];
-      case FilterMode::LP12:
-        return stage_outs[2];
-      case FilterMode::BP24:
-        return (stage_outs[2] + stage_outs[4]) * 4.0f - stage_outs[3] * 8.0f;
-      case FilterMode::BP12:
-        return (stage_outs[1] - stage_outs[2]) * 2.0f;
-      case FilterMode::HP24:
-        return stage_outs[0] + stage_outs[4] - ((stage_outs[1] + stage_outs[3]) * 4.0f) +
-          stage_outs[2] * 6.0f;
-      case FilterMode::HP12:
-        return stage_outs[0] + stage_outs[2] - stage_outs[1] * 2.0f;
-      default:
-        return 0.0f;
+  // Weighted filter stage mixing to achieve selected response
+  // as described in "Oscillator and Filter Algorithms for Virtual Analog Synthesis"
+  // Välimäki and Huovilainen, Computer Music Journal, vol 60, 2006
+  // (Sample is float, or q27 for FixedLadderFilter)
+  template <FilterMode stageMode, typename Sample>
+  static Sample mixStages(Sample u, Sample stage1, Sample stage2, Sample stage3, Sample stage4) {
+    if constexpr (stageMode == FilterMode::LP24) {
+      return stage4;
+    } else if constexpr (stageMode == FilterMode::LP12) {
+      return stage2;
+    } else if constexpr (stageMode == FilterMode::BP24) {
+      return (stage2 + stage4) * 4 - stage3 * 8;
+    } else if constexpr (stageMode == FilterMode::BP12) {
+      return (stage1 - stage2) * 2;
+    } else if constexpr (stageMode == FilterMode::HP24) {
+      return u + stage4 - ((stage1 + stage3) * 4) + stage2 * 6;
+    } else {
+      return u + stage2 - stage1 * 2;
+    }
+  }
+
+  // Runs the filter with the mode fixed at compile time, with the filter state
+  // in locals so it can stay in registers instead of being reloaded every time
+  // something gets written to buf.
+  template <FilterMode blockMode>
+  void processBlockForMode(float* buf, size_t size) {
+    float z0Local[4] = {z0[0], z0[1], z0[2], z0[3]};
+    float z1Local[4] = {z1[0], z1[1], z1[2], z1[3]};
+    float alphaLocal = alpha;
+    float QadjustLocal = Qadjust;
+    float oldinputLocal = oldinput;
+    uint rampLeft = rampSamplesLeft;
+
+    auto lpf = [&](float s, int i) {
+      //             (1.0 / 1.3)   (0.3 / 1.3)
+      float ft = s * 0.76923077f + 0.23076923f * z0Local[i] - z1Local[i];
+      ft = ft * alphaLocal + z1Local[i];
+      z1Local[i] = ft;
+      z0Local[i] = s;
+      return ft;
+    };
+
+    for (size_t i = 0; i < size; i++) {
+      if (rampLeft) {
+        rampLeft--;
+        if (rampLeft) {
+          alphaLocal += alphaIncrement;
+          QadjustLocal += QadjustIncrement;
+        } else {
+          // land exactly on the target
+          alphaLocal = targetAlpha;
+          QadjustLocal = targetQadjust;
+        }
+      }
+
+      float input = buf[i] * driveScaled;
+      float total = 0.0f;
+      float interp = 0.0f;
+#pragma GCC unroll 4
+      for (uint os = 0; os < interpolation; os++) {
+        float in_interp = (interp * oldinputLocal + (1.0f - interp) * input);
+        float u = in_interp - (z1Local[3] - pbg * in_interp) * K * QadjustLocal;
+        u = tanhRational(u);
+        float stage1 = lpf(u, 0);
+        float stage2 = lpf(stage1, 1);
+        float stage3 = lpf(stage2, 2);
+        float stage4 = lpf(stage3, 3);
+        total += mixStages<blockMode, float>(u, stage1, stage2, stage3, stage4) * interpolationRecip;
+        interp += interpolationRecip;
+      }
+      oldinputLocal = input;
+      buf[i] = total;
+    }
+
+    for (int i = 0; i < 4; i++) {
+      z0[i] = z0Local[i];
+      z1[i] = z1Local[i];
     }
+    alpha = alphaLocal;
+    Qadjust = QadjustLocal;
+    oldinput = oldinputLocal;
+    rampSamplesLeft = rampLeft;
   }
 
   /**
       Sets the filter mode/response
-      Defaults to classic lowpass 24dB/oct
+      Defaults to classic lowpass 24dB/oct (or the first of modes). Modes that
+      aren't in modes get ignored.
    */
   inline void setFilterMode(FilterMode modeIn) {
-    mode = modeIn;
+    if (isSupportedMode(modeIn)) {
+      mode = modeIn;
+    }
   }
 
-  private:
-  static constexpr uint8_t interpolation = 4;
+  static constexpr bool isSupportedMode(FilterMode modeIn) {
+    if constexpr (sizeof...(modes) == 0) {
+      return true;
+    } else {
+      return ((modeIn == modes) || ...);
+    }
+  }
+
+  protected:
+  static constexpr uint8_t interpolation = oversampling;
   static constexpr float interpolationRecip = 1.0f / interpolation;
   static constexpr float maxResonance = 1.8f;
+  // 0.425 at 4x oversampling
+  static constexpr float maxCutoffRatio = 0.425f / 4 * oversampling;
+
+  static constexpr FilterMode defaultMode() {
+    FilterMode supported[] = {modes..., FilterMode::LP24};
+    return supported[0];
+  }
+
+  // calls process.template operator()<mode>() for the current mode
+  template <typename Process>
+  void dispatchMode(Process&& process) {
+    if constexpr (sizeof...(modes) == 1) {
+      process.template operator()<modes...>();
+    } else if constexpr (sizeof...(modes) == 0) {
+      switch (mode) {
+        case FilterMode::LP24:
+          process.template operator()<FilterMode::LP24>();
+          break;
+        case FilterMode::LP12:
+          process.template operator()<FilterMode::LP12>();
+          break;
+        case FilterMode::BP24:
+          process.template operator()<FilterMode::BP24>();
+          break;
+        case FilterMode::BP12:
+          process.template operator()<FilterMode::BP12>();
+          break;
+        case FilterMode::HP24:
+          process.template operator()<FilterMode::HP24>();
+          break;
+        case FilterMode::HP12:
+          process.template operator()<FilterMode::HP12>();
+          break;
+      }
+    } else {
+      ((mode == modes && (process.template operator()<modes>(), true)) || ...);
+    }
+  }
 
   float sampleRate, srIntRecip;
   float alpha;
-  float beta[4] = {0.0, 0.0, 0.0, 0.0};
   float z0[4] = {0.0, 0.0, 0.0, 0.0};
   float z1[4] = {0.0, 0.0, 0.0, 0.0};
   float K;
   float Fbase;
   float Qadjust;
-  float pbg;
-  float drive, driveScaled;
+  // rampFreq() state
+  float targetAlpha, targetQadjust;
+  float alphaIncrement, QadjustIncrement;
+  uint rampSamplesLeft;
+  float pbg = 0.0f;
+  float drive = 0.0f, driveScaled = 0.0f;
   float oldinput;
   FilterMode mode;
 };
 
+/**
+ * LadderFilter that goes up to the oversampled rate and back down with the
+ * half-band filters in resample.hpp, instead of interpolating linearly and
+ * averaging the sub-samples. That keeps most of what the clipper and the
+ * resonance make above the Nyquist frequency from folding back down, which
+ * averaging hardly does: driven hard at 4x the aliasing goes from -16dB to
+ * -62dB, for ~13% more time. Delays the output by 15 samples at 2x and ~19 at
+ * 4x.
+ */
+template <uint oversampling = 4, LadderFilterMode... modes>
+class HalfBandLadderFilter : public LadderFilter<oversampling, modes...> {
+  static_assert(oversampling == 2 || oversampling == 4,
+                "HalfBandLadderFilter oversampling has to be 2 or 4");
+  using Base = LadderFilter<oversampling, modes...>;
+
+  public:
+  using FilterMode = LadderFilterMode;
+
+  void init(float sampleRateIn) {
+    Base::init(sampleRateIn);
+    resampler.init();
+  }
+
+  float process(float in) {
+    PROFILE_SCOPE("filter");
+    this->dispatchMode([&]<FilterMode blockMode>() { processBlockForMode<blockMode>(&in, 1); });
+    return in;
+  }
+
+  void processBlock(float* buf, size_t size) {
+    PROFILE_SCOPE("filter");
+    this->dispatchMode([&]<FilterMode blockMode>() { processBlockForMode<blockMode>(buf, size); });
+  }
+
+  private:
+  template <FilterMode blockMode>
+  void processBlockForMode(float* buf, size_t size) {
+    float z0Local[4] = {this->z0[0], this->z0[1], this->z0[2], this->z0[3]};
+    float z1Local[4] = {this->z1[0], this->z1[1], this->z1[2], this->z1[3]};
+    float alphaLocal = this->alpha;
+    float QadjustLocal = this->Qadjust;
+    uint rampLeft = this->rampSamplesLeft;
+    const float pbg = this->pbg, K = this->K;
+
+    auto lpf = [&](float s, int i) {
+      float ft = s * 0.76923077f + 0.23076923f * z0Local[i] - z1Local[i];
+      ft = ft * alphaLocal + z1Local[i];
+      z1Local[i] = ft;
+      z0Local[i] = s;
+      return ft;
+    };
+
+    for (size_t i = 0; i < size; i++) {
+      buf[i] *= this->driveScaled;
+    }
+
+    resampler.processBlock(buf, size, [&](float* oversampled, size_t count) {
+      for (size_t i = 0; i < count; i += oversampling) {
+        // the ramp still steps once per sample at the normal rate
+        if (rampLeft) {
+          rampLeft--;
+          if (rampLeft) {
+            alphaLocal += this->alphaIncrement;
+            QadjustLocal += this->QadjustIncrement;
+          } else {
+            alphaLocal = this->targetAlpha;
+            QadjustLocal = this->targetQadjust;
+          }
+        }
+
+#pragma GCC unroll 4
+        for (uint os = 0; os < oversampling; os++) {
+          float in = oversampled[i + os];
+          float u = in - (z1Local[3] - pbg * in) * K * QadjustLocal;
+          u = tanhRational(u);
+          float stage1 = lpf(u, 0);
+          float stage2 = lpf(stage1, 1);
+          float stage3 = lpf(stage2, 2);
+          float stage4 = lpf(stage3, 3);
+          oversampled[i + os] = Base::template mixStages<blockMode, float>(u, stage1, stage2, stage3, stage4);
+        }
+      }
+    });
+
+    for (int i = 0; i < 4; i++) {
+      this->z0[i] = z0Local[i];
+      this->z1[i] = z1Local[i];
+    }
+    this->alpha = alphaLocal;
+    this->Qadjust = QadjustLocal;
+    this->rampSamplesLeft = rampLeft;
+  }
+
+  Oversampler<oversampling> resampler;
+};
+
+/**
+ * LadderFilter for Q27 samples (see fixed.hpp). The coefficients still get
+ * worked out in float by the setters, which only run at control rate, and get
+ * turned into fixed point at the start of every block. The filter itself runs
+ * with the state in Q27, the coefficients in Q30 and tanhQ27() for the
+ * clipper, about 1.5e-6 away from the float one.
+ */
+template <uint oversampling = 4, LadderFilterMode... modes>
+class FixedLadderFilter : public LadderFilter<oversampling, modes...> {
+  using Base = LadderFilter<oversampling, modes...>;
+
+  public:
+  using FilterMode = LadderFilterMode;
+
+  void init(float sampleRateIn) {
+    Base::init(sampleRateIn);
+    for (int i = 0; i < 4; i++) {
+      z0[i] = 0;
+      z1[i] = 0;
+    }
+    oldinput = 0;
+  }
+
+  q27 process(q27 in) {
+    PROFILE_SCOPE("filter");
+    this->dispatchMode([&]<FilterMode blockMode>() { processBlockForMode<blockMode>(&in, 1); });
+    return in;
+  }
+
+  void processBlock(q27* buf, size_t size) {
+    PROFILE_SCOPE("filter");
+    this->dispatchMode([&]<FilterMode blockMode>() { processBlockForMode<blockMode>(buf, size); });
+  }
+
+  private:
+  template <FilterMode blockMode>
+  void processBlockForMode(q27* buf, size_t size) {
+    //                                    (1.0 / 1.3)               (0.3 / 1.3)
+    constexpr int32_t inputGain = floatToFixed<30>(0.76923077f), z0Gain = floatToFixed<30>(0.23076923f);
+    constexpr uint interpolation = Base::interpolation;
+
+    q27 z0Local[4] = {z0[0], z0[1], z0[2], z0[3]};
+    q27 z1Local[4] = {z1[0], z1[1], z1[2], z1[3]};
+    q27 oldinputLocal = oldinput;
+    int32_t alpha = floatToFixed<30>(this->alpha);
+    int32_t Qadjust = floatToFixed<30>(this->Qadjust);
+    uint rampLeft = this->rampSamplesLeft;
+    int32_t alphaIncrement = 0, QadjustIncrement = 0, targetAlpha = 0, targetQadjust = 0;
+    if (rampLeft) {
+      alphaIncrement = floatToFixed<30>(this->alphaIncrement);
+      QadjustIncrement = floatToFixed<30>(this->QadjustIncrement);
+      targetAlpha = floatToFixed<30>(this->targetAlpha);
+      targetQadjust = floatToFixed<30>(this->targetQadjust);
+    }
+    q27 K = floatToQ27(this->K);
+    int32_t pbg = floatToFixed<30>(this->pbg);
+    q27 driveScaled = floatToQ27(this->driveScaled);
+
+    auto lpf = [&](q27 s, int i) {
+      q27 ft = mulShift<30>(s, inputGain) + mulShift<30>(z0Local[i], z0Gain) - z1Local[i];
+      ft = mulShift<30>(ft, alpha) + z1Local[i];
+      z1Local[i] = ft;
+      z0Local[i] = s;
+      return ft;
+    };
+
+    for (size_t i = 0; i < size; i++) {
+      if (rampLeft) {
+        rampLeft--;
+        if (rampLeft) {
+          alpha += alphaIncrement;
+          Qadjust += QadjustIncrement;
+        } else {
+          alpha = targetAlpha;
+          Qadjust = targetQadjust;
+        }
+      }
+
+      q27 feedback = mulShift<30>(K, Qadjust);
+      q27 input = mulShift<q27Bits>(buf[i], driveScaled);
+      q27 step = (oldinputLocal - input) / (int32_t)interpolation;
+      q27 total = 0;
+#pragma GCC unroll 4
+      for (uint os = 0; os < interpolation; os++) {
+        q27 in_interp = input + step * (int32_t)os;
+        q27 u = in_interp - mulShift<q27Bits>(z1Local[3] - mulShift<30>(in_interp, pbg), feedback);
+        u = tanhQ27(u);
+        q27 stage1 = lpf(u, 0);
+        q27 stage2 = lpf(stage1, 1);
+        q27 stage3 = lpf(stage2, 2);
+        q27 stage4 = lpf(stage3, 3);
+        total += Base::template mixStages<blockMode, q27>(u, stage1, stage2, stage3, stage4);
+      }
+      oldinputLocal = input;
+      buf[i] = total / (int32_t)interpolation;
+    }
+
+    for (int i = 0; i < 4; i++) {
+      z0[i] = z0Local[i];
+      z1[i] = z1Local[i];
+    }
+    oldinput = oldinputLocal;
+    if (this->rampSamplesLeft) {
+      // so the next rampFreq() starts from here
+      this->alpha = rampLeft ? fixedToFloat<30>(alpha) : this->targetAlpha;
+      this->Qadjust = rampLeft ? fixedToFloat<30>(Qadjust) : this->targetQadjust;
+      this->rampSamplesLeft = rampLeft;
+    }
+  }
+
+  q27 z0[4] = {0, 0, 0, 0};
+  q27 z1[4] = {0, 0, 0, 0};
+  q27 oldinput = 0;
+};
+
 }  // namespace platform
 
-#endif  // PLATFORM_LADDER_H
\ No newline at end of file
+#endif  // PLATFORM_LADDER_H
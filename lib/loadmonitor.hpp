@@ -0,0 +1,185 @@
+#ifndef PLATFORM_LOAD_MONITOR_H
+#define PLATFORM_LOAD_MONITOR_H
+
+#include "statechannel.hpp"
+
+#include <atomic>
+#include <stdint.h>
+#include <stdio.h>
+#include <sys/types.h>
+
+namespace platform {
+
+// load is bucketed by whole percent of the time one buffer lasts, the last
+// bucket is everything from 100% up
+const uint loadBuckets = 101;
+
+struct LoadStats {
+  uint32_t buffers;
+  uint64_t minRenderUs;
+  uint64_t maxRenderUs;
+  uint64_t totalRenderUs;
+  uint32_t histogram[loadBuckets];
+  // buffers that took longer to render than they take to play
+  uint32_t missedDeadlines;
+  // times the output ran out of buffers (estimated, see LoadMonitor)
+  uint32_t underruns;
+
+  LoadStats() {
+    reset();
+  }
+
+  void reset() {
+    buffers = 0;
+    minRenderUs = UINT64_MAX;
+    maxRenderUs = 0;
+    totalRenderUs = 0;
+    for (uint i = 0; i < loadBuckets; i++) {
+      histogram[i] = 0;
+    }
+    missedDeadlines = 0;
+    underruns = 0;
+  }
+
+  // as a percentage of the buffer period
+  float getLoad(uint64_t renderUs, uint64_t periodUs) const {
+    return renderUs * 100.f / periodUs;
+  }
+
+  // the load that percentile% of the buffers were at or below, rounded up to
+  // the bucket
+  uint getPercentile(float percentile) const {
+    uint32_t needed = (uint32_t)(buffers * percentile / 100.f + 0.5f);
+    uint32_t seen = 0;
+    for (uint i = 0; i < loadBuckets; i++) {
+      seen += histogram[i];
+      if (seen >= needed && seen) {
+        return i + 1;
+      }
+    }
+    return loadBuckets;
+  }
+};
+
+// take_audio_buffer() blocking for longer than this means all buffers were
+// queued up
+const uint64_t blockedUs = 20;
+
+/*
+Keeps track of how long each buffer takes to render and whether the output keeps
+up. The render side calls beginBuffer() and endBuffer() around every buffer. The
+reporting side (which can be on the other core) calls requestReport() and prints
+once acquireReport() returns true. That gets everything since the previous
+report.
+
+Underruns are estimated by keeping track of when the output will run out of what
+it has been given. When taking a buffer had to block, all the others are queued
+and one just finished playing, which pins that time down again so it doesn't
+drift.
+*/
+struct LoadMonitor {
+  LoadMonitor()
+    : periodUs{0},
+      bufferCount{0},
+      takenUs{0},
+      queueEndUs{0},
+      reportRequested{false} {}
+
+  void init(float sampleRate, uint samplesPerBuffer, uint bufferCountIn) {
+    periodUs = (uint64_t)(samplesPerBuffer * 1000000.f / sampleRate);
+    bufferCount = bufferCountIn;
+  }
+
+  // render side: right after taking the buffer, waitedUs is how long that took
+  void beginBuffer(uint64_t waitedUs, uint64_t nowUs) {
+    takenUs = nowUs;
+    if (waitedUs > blockedUs) {
+      queueEndUs = nowUs + (bufferCount - 1) * periodUs;
+    }
+  }
+
+  // render side: right after giving the buffer to the output
+  void endBuffer(uint64_t nowUs) {
+    uint64_t renderUs = nowUs - takenUs;
+
+    stats.buffers++;
+    stats.totalRenderUs += renderUs;
+    if (renderUs < stats.minRenderUs) {
+      stats.minRenderUs = renderUs;
+    }
+    if (renderUs > stats.maxRenderUs) {
+      stats.maxRenderUs = renderUs;
+    }
+
+    uint bucket = (uint)stats.getLoad(renderUs, periodUs);
+    if (bucket >= loadBuckets) {
+      bucket = loadBuckets - 1;
+    }
+    stats.histogram[bucket]++;
+
+    if (renderUs > periodUs) {
+      stats.missedDeadlines++;
+    }
+
+    if (nowUs > queueEndUs) {
+      // nothing was left to play, so this one starts playing straight away
+      if (queueEndUs) {
+        stats.underruns++;
+      }
+      queueEndUs = nowUs;
+    }
+    queueEndUs += periodUs;
+
+    if (reportRequested.load(std::memory_order_relaxed)) {
+      reportRequested.store(false, std::memory_order_relaxed);
+      reports.write() = stats;
+      reports.publish();
+      stats.reset();
+    }
+  }
+
+  // reporting side
+  void requestReport() {
+    reportRequested.store(true, std::memory_order_relaxed);
+  }
+
+  // reporting side: true once the requested report is ready for printReport()
+  bool acquireReport() {
+    return reports.acquire();
+  }
+
+  void printReport() {
+    const LoadStats& report = reports.read();
+    if (!report.buffers) {
+      printf("load: no buffers\n");
+      return;
+    }
+
+    printf("load: %lu buffers, render %llu/%llu/%lluus min/avg/max, "
+           "load %.1f/%.1f/%.1f%% min/avg/max, p99 <=%u%%, %lu missed deadlines, %lu underruns\n",
+           (unsigned long)report.buffers,
+           (unsigned long long)report.minRenderUs,
+           (unsigned long long)(report.totalRenderUs / report.buffers),
+           (unsigned long long)report.maxRenderUs,
+           report.getLoad(report.minRenderUs, periodUs),
+           report.getLoad(report.totalRenderUs / report.buffers, periodUs),
+           report.getLoad(report.maxRenderUs, periodUs),
+           report.getPercentile(99.f),
+           (unsigned long)report.missedDeadlines,
+           (unsigned long)report.underruns);
+  }
+
+  private:
+  uint64_t periodUs;
+  uint bufferCount;
+  uint64_t takenUs;
+  // when the output will have played everything it has been given
+  uint64_t queueEndUs;
+  LoadStats stats;
+  std::atomic<bool> reportRequested;
+  StateChannel<LoadStats> reports;
+};
+
+}  // namespace platform
+
+#endif  // PLATFORM_LOAD_MONITOR_H
@@ -1,13 +1,15 @@
 #ifndef PLATFORM_METRO_H
 #define PLATFORM_METRO_H
 
+#include "phase.hpp"
 #include "utils.hpp"
 
 namespace platform {
 
 /**
  * Creates a clock signal at a specific frequency.
- * ported from daisysp
+ * ported from daisysp, with the phase as a PhaseAccumulator instead of a float
+ * in radians so the clock doesn't drift at low BPM
  */
 class Metro {
   public:
@@ -22,23 +24,16 @@ class Metro {
   */
   void init(float freqIn, float sampleRateIn) {
     freq = freqIn;
-    phs = 0.0f;
-    sampleRate = sampleRateIn;
-    phsInc = (TWOPI_F * freq) / sampleRateIn;
+    phase.init(sampleRateIn);
+    phase.setFreq(freq);
     isClockTick = false;
   }
 
   /** checks current state of Metro object and updates state if necesary.
    */
   uint8_t process() {
-    phs += phsInc;
-    if (phs >= TWOPI_F) {
-      phs -= TWOPI_F;
-      isClockTick = true;
-      return 1;
-    }
-    isClockTick = false;
-    return 0;
+    isClockTick = phase.process();
+    return isClockTick;
   }
 
   bool isTick() {
@@ -48,13 +43,13 @@ class Metro {
   /** resets phase to 0
    */
   inline void reset() {
-    phs = 0.0f;
+    phase.reset();
   }
   /** Sets frequency at which Metro module will run at.
    */
-  void setFreq(float freq) {
-    freq = freq;
-    phsInc = (TWOPI_F * freq) / sampleRate;
+  void setFreq(float freqIn) {
+    freq = freqIn;
+    phase.setFreq(freq);
   }
 
   /** Returns current value for frequency.
@@ -63,15 +58,15 @@ class Metro {
     return freq;
   }
 
-  /** Returns current value for phase.
+  /** Returns current value for phase in radians.
    */
   inline float getPhase() {
-    return phs;
+    return phase.getPhase() * TWOPI_F;
   }
 
   private:
   float freq;
-  float phs, sampleRate, phsInc;
+  PhaseAccumulator phase;
   bool isClockTick;
 };
 
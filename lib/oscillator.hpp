@@ -8,6 +8,8 @@ https://opensource.org/licenses/MIT.
 
 #ifndef PLATFORM_OSCILLATOR_H
 #define PLATFORM_OSCILLATOR_H
+#include "phase.hpp"
+#include "profile.hpp"
 #include "utils.hpp"
 #include <stdint.h>
 
@@ -27,6 +29,7 @@ static float polyblep(float phaseInc, float t) {
 }
 
 /** Synthesis of several waveforms, including polyBLEP bandlimited waveforms.
+    The phase is a PhaseAccumulator, the waveforms get computed from it as a float.
  */
 class Oscillator {
   public:
@@ -60,11 +63,10 @@ class Oscillator {
   void init(float sampleRate) {
     sr = sampleRate;
     srRecip = 1.0f / sampleRate;
-    freq = 100.0f;
     amp = 0.5f;
     pw = 0.5f;
-    phase = 0.0f;
-    phaseInc = calcPhaseInc(freq);
+    phaseAccumulator.init(sampleRate);
+    setFreq(100.0f);
     waveform = WAVE_SIN;
     eoc = true;
     eor = true;
@@ -75,6 +77,7 @@ class Oscillator {
   inline void setFreq(const float f) {
     freq = f;
     phaseInc = calcPhaseInc(f);
+    phaseAccumulator.setFreq(f);
   }
 
   /** Sets the amplitude of the waveform.
@@ -110,20 +113,22 @@ class Oscillator {
   /** Returns true if cycle rising.
    */
   inline bool isRising() {
-    return phase < 0.5f;
+    return phaseAccumulator.isRising();
   }
 
   /** Returns true if cycle falling.
    */
   inline bool isFalling() {
-    return phase >= 0.5f;
+    return !phaseAccumulator.isRising();
   }
 
   /** Processes the waveform to be generated, returning one sample. This should be called once per
    * sample period.
    */
   float process() {
+    PROFILE_SCOPE("oscillator");
     float out, t;
+    float phase = phaseAccumulator.getPhase();
     switch (waveform) {
       case WAVE_SIN:
         out = sinf(phase * TWOPI_F);
@@ -169,32 +174,27 @@ class Oscillator {
         out = 0.0f;
         break;
     }
-    phase += phaseInc;
-    if (phase > 1.0f) {
-      phase -= 1.0f;
-      eoc = true;
-    } else {
-      eoc = false;
-    }
-    eor = (phase - phaseInc < 0.5f && phase >= 0.5f);
+    bool wasRising = phaseAccumulator.isRising();
+    eoc = phaseAccumulator.process();
+    eor = wasRising && !phaseAccumulator.isRising();
 
     return out * amp;
   }
 
   float getPhase() {
-    return phase;
+    return phaseAccumulator.getPhase();
   }
 
   /** Adds a value 0.0-1.0 (equivalent to 0.0-TWO_PI) to the current phase. Useful for PM and "FM"
    * synthesis.
    */
   void phaseAdd(float phaseIn) {
-    phase += phaseIn;
+    phaseAccumulator.add(phaseIn);
   }
   /** Resets the phase to the input argument. If no argumeNt is present, it will reset phase to 0.0;
    */
   void reset(float phaseIn = 0.0f) {
-    phase = phaseIn;
+    phaseAccumulator.reset(phaseIn);
   }
 
   inline float calcPhaseInc(float f) {
@@ -204,7 +204,8 @@ class Oscillator {
   private:
   uint8_t waveform;
   float amp, freq, pw;
-  float sr, srRecip, phase, phaseInc;
+  float sr, srRecip, phaseInc;
+  PhaseAccumulator phaseAccumulator;
   float lastOut, lastFreq;
   bool eor, eoc;
 };
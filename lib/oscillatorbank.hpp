@@ -0,0 +1,340 @@
+#ifndef PLATFORM_OSCILLATORBANK_H
+#define PLATFORM_OSCILLATORBANK_H
+
+#include <stdint.h>
+#include <sys/types.h>
+
+#include <algorithm>
+#include <type_traits>
+
+#include "control.hpp"
+#include "fixed.hpp"
+#include "phase.hpp"
+#include "profile.hpp"
+#include "wavetable.hpp"
+
+namespace platform {
+
+// of a phase increment, which is negative for negative frequencies
+inline uint32_t getIncrementMagnitude(uint32_t increment) {
+  return (int32_t)increment < 0 ? -increment : increment;
+}
+
+/*
+The waveforms an OscillatorBank can play, picked at compile time so there's no
+switch per sample. Each has a State for the number of voices, which gets told
+whenever the voices' phase increments change (at most once per control block)
+and then reads one voice at a phase. isVectorisable says whether reading can be
+vectorised, which decides how the bank loops over the voices and samples.
+*/
+
+// Reads the band-limited tables (see wavetable.hpp). All voices share a table
+// level, the one for the highest frequency, which leaves the lower ones with a
+// few less harmonics at most. With Sample = q27 it reads the Q14 tables and
+// interpolates with smlad() on the M33, like FixedWavetableOscillator does.
+template <WavetableShape shape, typename SampleType = float>
+struct WavetableWaveform {
+  using Sample = SampleType;
+  // the table reads are a load per sample
+  static constexpr bool isVectorisable = false;
+  static constexpr bool isFixed = !std::is_floating_point_v<Sample>;
+  using Table = std::conditional_t<isFixed, FixedWavetable, Wavetable>;
+  using TableSample = std::conditional_t<isFixed, q15, float>;
+
+  template <uint voices>
+  struct State {
+    // builds the tables if nothing has used them yet
+    void init() {
+      if constexpr (isFixed) {
+        wavetable = &getFixedWavetable(shape);
+      } else {
+        wavetable = &getWavetable(shape);
+      }
+      table = wavetable->getLevel(0);
+    }
+
+    void update(const uint32_t* increments, const uint32_t* targets) {
+      uint32_t highest = 0;
+      for (uint voice = 0; voice < voices; voice++) {
+        highest = std::max(highest, getIncrementMagnitude(increments[voice]));
+        highest = std::max(highest, getIncrementMagnitude(targets[voice]));
+      }
+      table = wavetable->getLevel(Wavetable::getLevelFor(highest));
+    }
+
+    Sample read(uint, uint32_t phase) const {
+      return readWavetable(table, phase);
+    }
+
+    const Table* wavetable;
+    const TableSample* table;
+  };
+};
+
+// A falling saw like Oscillator::WAVE_POLYBLEP_SAW, computed instead of read,
+// so the voices don't need any memory. The polyBLEP correction is the same
+// branch free expression for every voice, which the compiler can vectorise
+// along with the saws.
+struct PolyBlepSaw {
+  using Sample = float;
+  static constexpr bool isVectorisable = true;
+
+  template <uint voices>
+  struct State {
+    void init() {
+      for (uint voice = 0; voice < voices; voice++) {
+        widths[voice] = 0;
+        widthRecips[voice] = 0.f;
+      }
+    }
+
+    // the widest step while ramping, so the correction covers the whole wrap
+    void update(const uint32_t* increments, const uint32_t* targets) {
+      for (uint voice = 0; voice < voices; voice++) {
+        widths[voice] = std::max(getIncrementMagnitude(increments[voice]),
+                                 getIncrementMagnitude(targets[voice]));
+        widthRecips[voice] = widths[voice] ? 1.f / widths[voice] : 0.f;
+      }
+    }
+
+    float read(uint voice, uint32_t phase) const {
+      // the top 24 bits (all a float holds) as a signed int, which converts
+      // to float in one instruction where unsigned ones don't
+      float t = (int32_t)(phase >> 8) * (1.f / (1 << 24));
+      // polyblep() in oscillator.hpp, as -(1 - x)^2 with x how far past the
+      // wrap the phase is and (1 - y)^2 with y how far before it, both in
+      // steps. Those are 0 from one step away, so clamping the distances to a
+      // step is all it takes instead of branches, and the compiler can
+      // vectorise that (with integers, because it won't speculate float
+      // compares)
+      uint32_t after = std::min(phase, widths[voice]);
+      uint32_t before = std::min(~phase, widths[voice]);
+      float x = (float)(int32_t)after * widthRecips[voice];
+      float y = (float)(int32_t)before * widthRecips[voice];
+      float blep = (1.f - y) * (1.f - y) - (1.f - x) * (1.f - x);
+      return 1.f - 2.f * t + blep;
+    }
+
+    // the phase increment, the correction is one step either side of the wrap
+    uint32_t widths[voices];
+    float widthRecips[voices];
+  };
+};
+
+/*
+voices oscillators that all play the same Waveform and get rendered together a
+block at a time, like TEP's detuned pair or a supersaw. Their phases,
+increments and amplitudes are kept as arrays (one entry per voice) rather than
+as an array of oscillators. Waveforms that can be vectorised get rendered a
+voice at a time over the whole block, in a loop without any state carried from
+sample to sample, which the compiler vectorises (SSE/NEON on the host).
+
+Everything a single oscillator does per sample besides computing the waveform
+(setting the frequency, checking the table level, the switch over waveforms)
+happens once per block or control block here, so every voice after the first
+costs little more than its waveform.
+*/
+template <uint voices, typename Waveform = WavetableWaveform<WAVETABLE_SAW>>
+class OscillatorBank {
+  public:
+  using Sample = typename Waveform::Sample;
+  static constexpr bool isFixed = !std::is_floating_point_v<Sample>;
+
+  void init(float sampleRate) {
+    incrementPerHz = PhaseAccumulator::cycle / sampleRate;
+    for (uint voice = 0; voice < voices; voice++) {
+      phases[voice] = 0;
+      increments[voice] = 0;
+      targets[voice] = 0;
+      steps[voice] = 0;
+    }
+    rampSamplesLeft = 0;
+    isRetargeted = false;
+    waveform.init();
+    setAmp(1.f);
+  }
+
+  void setAmp(uint voice, float amp) {
+    if constexpr (isFixed) {
+      amplitudes[voice] = floatToFixed<30>(amp);
+    } else {
+      amplitudes[voice] = amp;
+    }
+  }
+
+  void setAmp(float amp) {
+    for (uint voice = 0; voice < voices; voice++) {
+      setAmp(voice, amp);
+    }
+  }
+
+  // sets the frequency of a voice right away
+  void setFreq(uint voice, float freq) {
+    increments[voice] = getIncrement(freq);
+    targets[voice] = increments[voice];
+    steps[voice] = 0;
+    waveform.update(increments, targets);
+  }
+
+  // spreads the voices evenly from freq * (1 - spread) to freq * (1 + spread),
+  // with the middle one (if there is one) on freq
+  void setFreqSpread(float freq, float spread) {
+    for (uint voice = 0; voice < voices; voice++) {
+      increments[voice] = getIncrement(freq * (1.f + spread * getSpreadOffset(voice)));
+      targets[voice] = increments[voice];
+      steps[voice] = 0;
+    }
+    waveform.update(increments, targets);
+  }
+
+  // Moves the frequency of a voice to freq over the next control block (see
+  // control.hpp), like LadderFilter::rampFreq(). All the voices ramp together,
+  // from where they are to their latest target.
+  void rampFreq(uint voice, float freq) {
+    targets[voice] = getIncrement(freq);
+    isRetargeted = true;
+  }
+
+  // the same for all of them, spread like setFreqSpread()
+  void rampFreqSpread(float freq, float spread) {
+    for (uint voice = 0; voice < voices; voice++) {
+      targets[voice] = getIncrement(freq * (1.f + spread * getSpreadOffset(voice)));
+    }
+    isRetargeted = true;
+  }
+
+  void reset(uint voice, float phase = 0.f) {
+    phases[voice] = (uint32_t)(int64_t)(phase * PhaseAccumulator::cycle);
+  }
+
+  float getPhase(uint voice) const {
+    return phases[voice] * (1.f / PhaseAccumulator::cycle);
+  }
+
+  // renders count samples of all the voices mixed together into out
+  void process(Sample* out, size_t count) {
+    PROFILE_SCOPE("oscillator");
+    if (isRetargeted) {
+      isRetargeted = false;
+      for (uint voice = 0; voice < voices; voice++) {
+        steps[voice] = ((int32_t)targets[voice] - (int32_t)increments[voice]) / CONTROL_BLOCK_SIZE;
+      }
+      rampSamplesLeft = CONTROL_BLOCK_SIZE;
+      waveform.update(increments, targets);
+    }
+
+    size_t ramped = rampSamplesLeft < count ? rampSamplesLeft : count;
+    render<true>(out, ramped);
+    render<false>(out + ramped, count - ramped);
+    if (rampSamplesLeft) {
+      rampSamplesLeft -= ramped;
+      if (!rampSamplesLeft) {
+        // land exactly on the targets
+        for (uint voice = 0; voice < voices; voice++) {
+          increments[voice] = targets[voice];
+          steps[voice] = 0;
+        }
+      }
+    }
+  }
+
+  private:
+  template <bool isRamping>
+  void render(Sample* out, size_t count) {
+    if constexpr (Waveform::isVectorisable) {
+      renderByVoice<isRamping>(out, count);
+    } else {
+      renderBySample<isRamping>(out, count);
+    }
+  }
+
+  // One voice at a time over the whole block, adding into out. Every sample's
+  // phase gets worked out from the one at the start of the block, so none of
+  // them depend on the previous sample and the loop can be vectorised. The
+  // voices still get summed in the same order for every sample.
+  template <bool isRamping>
+  void renderByVoice(Sample* out, size_t count) {
+    for (size_t i = 0; i < count; i++) {
+      out[i] = 0;
+    }
+
+    for (uint voice = 0; voice < voices; voice++) {
+      uint32_t phase = phases[voice];
+      uint32_t increment = increments[voice];
+      uint32_t step = steps[voice];
+      Sample amplitude = amplitudes[voice];
+      for (uint32_t i = 0; i < count; i++) {
+        uint32_t at = phase + i * increment;
+        if constexpr (isRamping) {
+          // the ramp steps first, like LinearRamp, so that's i + 1 steps so far
+          at += step * (i * (i + 1) / 2);
+        }
+        out[i] += mix(waveform.read(voice, at), amplitude);
+      }
+
+      uint32_t samples = count;
+      phases[voice] = phase + samples * increment;
+      if constexpr (isRamping) {
+        phases[voice] += step * (samples * (samples + 1) / 2);
+        increments[voice] = increment + samples * step;
+      }
+    }
+  }
+
+  // All the voices for one sample and then the next, which keeps the sum in a
+  // register. Faster when reading the waveform can't be vectorised anyway.
+  template <bool isRamping>
+  void renderBySample(Sample* out, size_t count) {
+    for (size_t i = 0; i < count; i++) {
+      uint32_t at[voices];
+#pragma GCC unroll 8
+      for (uint voice = 0; voice < voices; voice++) {
+        at[voice] = phases[voice];
+        if constexpr (isRamping) {
+          increments[voice] += steps[voice];
+        }
+        phases[voice] += increments[voice];
+      }
+
+      Sample sum = 0;
+#pragma GCC unroll 8
+      for (uint voice = 0; voice < voices; voice++) {
+        sum += mix(waveform.read(voice, at[voice]), amplitudes[voice]);
+      }
+      out[i] = sum;
+    }
+  }
+
+  static Sample mix(Sample value, Sample amplitude) {
+    if constexpr (isFixed) {
+      return mulShift<30>(value, amplitude);
+    } else {
+      return value * amplitude;
+    }
+  }
+
+  uint32_t getIncrement(float freq) const {
+    return (uint32_t)(int64_t)(freq * incrementPerHz);
+  }
+
+  // -1 to 1
+  static float getSpreadOffset(uint voice) {
+    return voices > 1 ? 2.f * voice / (voices - 1) - 1.f : 0.f;
+  }
+
+  typename Waveform::template State<voices> waveform;
+  float incrementPerHz;
+  uint32_t phases[voices];
+  uint32_t increments[voices];
+  uint32_t targets[voices];
+  // added to increments every sample while ramping
+  uint32_t steps[voices];
+  // Q30 for the fixed point one
+  Sample amplitudes[voices];
+  uint rampSamplesLeft;
+  bool isRetargeted;
+};
+
+}  // namespace platform
+
+#endif  // PLATFORM_OSCILLATORBANK_H
@@ -0,0 +1,73 @@
+#ifndef PLATFORM_PHASE_H
+#define PLATFORM_PHASE_H
+
+#include <stdint.h>
+
+namespace platform {
+
+/*
+Phase as a 32 bit fixed point fraction of a cycle, so a whole cycle is 2^32.
+Wrapping around is just the integer overflowing, the end of a cycle is the add
+carrying, and a frequency turns into an increment with one multiply. Unlike a
+float phase it doesn't lose precision or drift however long it runs, which
+keeps clocks in time: the only error is the increment being rounded to 2^-32
+of a cycle, a few ppm for a clock at 1Hz.
+
+Negative frequencies run backwards, process() only makes sense for positive
+ones though.
+*/
+struct PhaseAccumulator {
+  static constexpr float cycle = 4294967296.f;
+  static const uint32_t half = 0x80000000;
+
+  PhaseAccumulator() : phase{0}, increment{0}, incrementPerHz{0.f} {}
+
+  void init(float sampleRate) {
+    incrementPerHz = cycle / sampleRate;
+    phase = 0;
+    increment = 0;
+  }
+
+  void setFreq(float freq) {
+    // through int64_t so negative frequencies wrap instead of being undefined
+    increment = (uint32_t)(int64_t)(freq * incrementPerHz);
+  }
+
+  // advances one sample, true if that started a new cycle
+  bool process() {
+    uint32_t previous = phase;
+    phase += increment;
+    return phase < previous;
+  }
+
+  // 0 to 1
+  float getPhase() const {
+    return phase * (1.f / cycle);
+  }
+
+  // in cycles per sample
+  float getIncrement() const {
+    return (int32_t)increment * (1.f / cycle);
+  }
+
+  bool isRising() const {
+    return phase < half;
+  }
+
+  // adds a fraction of a cycle, any amount (also negative) works
+  void add(float cycles) {
+    phase += (uint32_t)(int64_t)(cycles * cycle);
+  }
+
+  void reset(float cycles = 0.f) {
+    phase = (uint32_t)(int64_t)(cycles * cycle);
+  }
+
+  uint32_t phase;
+  uint32_t increment;
+  float incrementPerHz;
+};
+
+}  // namespace platform
+
+#endif  // PLATFORM_PHASE_H
@@ -0,0 +1,90 @@
+#ifndef PLATFORM_PITCH_H
+#define PLATFORM_PITCH_H
+
+#include <math.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/types.h>
+
+namespace platform {
+
+/*
+Pitches (in semitones) to frequencies without a powf(). 2^(semitones / 12) is
+a power of 2 for the whole octaves, which goes straight into the float's
+exponent, times 2^fraction of an octave, which comes from a table of 1024
+steps per octave (~1/85 of a semitone). Between two steps the curve is so
+close to a straight line that interpolating linearly is within 6e-8 of it
+(relative), as close as a float gets, so that's as good as interpolating in
+the log domain. Altogether it's within ~3e-7 of pow() over 4 octaves either
+way, which is 0.0005 cents.
+
+Every octave is the same table doubled, so the one octave covers every note
+(4KB, instead of 22KB for 1/64 of a semitone across all 88 keys). It gets
+worked out by the compiler and lives in flash.
+*/
+const uint pitchTableBits = 10;
+const uint pitchTableSize = 1 << pitchTableBits;
+
+// 2^x for x from 0 to 1, for building the table (exp2() isn't constexpr)
+constexpr double constexprExp2(double x) {
+  // the series for e^(x ln 2), which has converged well before 24 terms here
+  const double ln2 = 0.69314718055994531;
+  double term = 1.0;
+  double sum = 1.0;
+  for (int n = 1; n < 24; n++) {
+    term *= x * ln2 / n;
+    sum += term;
+  }
+  return sum;
+}
+
+struct PitchTable {
+  constexpr PitchTable() : ratios{} {
+    for (uint i = 0; i <= pitchTableSize; i++) {
+      ratios[i] = (float)constexprExp2((double)i / pitchTableSize);
+    }
+  }
+
+  // 1 to 2, one more than the size so interpolating doesn't need to wrap
+  float ratios[pitchTableSize + 1];
+};
+
+inline constexpr PitchTable pitchTable;
+
+// 2^(semitones / 12), what a frequency gets multiplied by to move it up (or
+// down, for negative ones) by that many semitones
+inline float semitonesToRatio(float semitones) {
+  float position = semitones * (pitchTableSize / 12.f);
+  // a float only has octaves from 2^-126 to 2^127, and this keeps the cast
+  // below defined
+  const float limit = 126.f * pitchTableSize;
+  position = position > limit ? limit : position < -limit ? -limit : position;
+
+  float whole = floorf(position);
+  float fraction = position - whole;
+  int32_t steps = (int32_t)whole;
+  // both round down, also for negative steps
+  int32_t octave = steps >> pitchTableBits;
+  uint index = steps & (pitchTableSize - 1);
+
+  float ratio = pitchTable.ratios[index] +
+    (pitchTable.ratios[index + 1] - pitchTable.ratios[index]) * fraction;
+  // 2^octave
+  uint32_t bits = (uint32_t)(octave + 127) << 23;
+  float octaveRatio;
+  memcpy(&octaveRatio, &bits, sizeof(octaveRatio));
+  return ratio * octaveRatio;
+}
+
+// A0, the lowest key of a piano
+const float lowestNoteFrequency = 27.5f;
+
+// The frequency of a note, with 0 as A0 like notes[] in quantize.hpp. Notes in
+// between keys are in between in pitch.
+inline float pitchToFrequency(float note) {
+  return lowestNoteFrequency * semitonesToRatio(note);
+}
+
+}  // namespace platform
+
+#endif  // PLATFORM_PITCH_H
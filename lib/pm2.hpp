@@ -9,7 +9,7 @@ https://opensource.org/licenses/MIT.
 #ifndef PLATFORM_FM2_H
 #define PLATFORM_FM2_H
 
-#include "oscillator.hpp"
+#include "wavetable.hpp"
 
 namespace platform {
 
@@ -33,8 +33,8 @@ struct PM2 {
     ldepth = 1.f;
     mod.setAmp(ldepth);
 
-    car.setWaveform(Oscillator::WAVE_SIN);
-    mod.setWaveform(Oscillator::WAVE_SIN);
+    car.setWaveform(WavetableOscillator::WAVE_SIN);
+    mod.setWaveform(WavetableOscillator::WAVE_SIN);
   }
   
   float process() {
@@ -74,7 +74,7 @@ struct PM2 {
   }
 
   private:
-    Oscillator mod, car;
+    WavetableOscillator mod, car;
     float      freq, lfreq, ratio, lratio, ldepth, depth;
 };
 } // namespace platform
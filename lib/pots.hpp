@@ -1,6 +1,8 @@
 #ifndef PLATFORM_POTS_H
 #define PLATFORM_POTS_H
 
+#include <math.h>
+
 #include "hardware/adc.h"
 #include "hardware/gpio.h"
 
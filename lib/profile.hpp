@@ -0,0 +1,222 @@
+#ifndef PLATFORM_PROFILE_H
+#define PLATFORM_PROFILE_H
+
+#include "statechannel.hpp"
+
+#include <atomic>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/types.h>
+
+#if defined(PLATFORM_PROFILE) && defined(PICO_RP2350)
+#include "hardware/structs/m33.h"
+#elif defined(PLATFORM_PROFILE) && (defined(__x86_64__) || defined(__i386__))
+#include <x86intrin.h>
+#elif defined(PLATFORM_PROFILE)
+#include <time.h>
+#endif
+
+/*
+Scoped probes for timing the stages of the audio path:
+
+  float process(float in) {
+    PROFILE_SCOPE("filter");
+    ...
+  }
+
+They only get compiled in when PLATFORM_PROFILE is defined (the
+PLATFORM16_PROFILE cmake option), otherwise PROFILE_SCOPE() is nothing at all.
+Every probe adds the time from where it is to the end of its scope to its entry
+in the profiler's table, so probes that are nested inside other probes get
+counted in both.
+
+On the board the time is in cycles from the Cortex-M33's DWT cycle counter. On
+x86 it comes from rdtsc and anywhere else from clock_gettime() in nanoseconds,
+so on the host the numbers are comparable between the stages, but not directly
+with the board.
+*/
+
+namespace platform {
+
+#if defined(PLATFORM_PROFILE) && defined(PICO_RP2350)
+// 32 bit and wraps every 28 seconds at 150MHz, but the difference between two
+// reads is right as long as a probe lasts less than that
+using ProfileTime = uint32_t;
+
+inline ProfileTime readProfileTime() {
+  return m33_hw->dwt_cyccnt;
+}
+
+// the cycle counter is per core, so this has to run on every core with probes
+inline void startProfileTime() {
+  m33_hw->demcr |= M33_DEMCR_TRCENA_BITS;
+  m33_hw->dwt_ctrl |= M33_DWT_CTRL_CYCCNTENA_BITS;
+}
+#elif defined(PLATFORM_PROFILE) && (defined(__x86_64__) || defined(__i386__))
+using ProfileTime = uint64_t;
+
+inline ProfileTime readProfileTime() {
+  return __rdtsc();
+}
+
+inline void startProfileTime() {}
+#else
+using ProfileTime = uint64_t;
+
+inline ProfileTime readProfileTime() {
+#ifdef PLATFORM_PROFILE
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (uint64_t)now.tv_sec * 1000000000ull + now.tv_nsec;
+#else
+  return 0;
+#endif
+}
+
+inline void startProfileTime() {}
+#endif
+
+const uint maxProfileEntries = 24;
+
+struct ProfileEntry {
+  const char* name;
+  uint32_t calls;
+  uint64_t total;
+  ProfileTime max;
+};
+
+struct ProfileTable {
+  ProfileEntry entries[maxProfileEntries];
+  uint count;
+
+  ProfileTable() : count{0} {}
+
+  void reset() {
+    for (uint i = 0; i < count; i++) {
+      entries[i].calls = 0;
+      entries[i].total = 0;
+      entries[i].max = 0;
+    }
+  }
+
+  void print() const {
+    if (!count) {
+#ifdef PLATFORM_PROFILE
+      printf("profile: nothing was profiled\n");
+#else
+      printf("profile: built without PLATFORM_PROFILE\n");
+#endif
+      return;
+    }
+
+    printf("profile: %-16s %10s %14s %10s %10s\n", "", "calls", "total", "avg", "max");
+    for (uint i = 0; i < count; i++) {
+      const ProfileEntry& entry = entries[i];
+      if (!entry.calls) {
+        continue;
+      }
+      printf("profile: %-16s %10lu %14llu %10llu %10llu\n",
+             entry.name,
+             (unsigned long)entry.calls,
+             (unsigned long long)entry.total,
+             (unsigned long long)(entry.calls ? entry.total / entry.calls : 0),
+             (unsigned long long)entry.max);
+    }
+  }
+};
+
+/*
+The table the probes add to. The render side calls endBuffer() once per buffer.
+Like LoadMonitor, the reporting side (which can be on the other core) calls
+requestReport() and prints once acquireReport() returns true, which gets
+everything since the previous report. Single threaded code (the host tools) can
+just print and reset the table directly.
+*/
+struct Profiler {
+  Profiler() : reportRequested{false} {}
+
+  // the entry for name, adding it if it is new. nullptr if the table is full
+  ProfileEntry* getEntry(const char* name) {
+    for (uint i = 0; i < table.count; i++) {
+      if (strcmp(table.entries[i].name, name) == 0) {
+        return &table.entries[i];
+      }
+    }
+    if (table.count == maxProfileEntries) {
+      return nullptr;
+    }
+    ProfileEntry* entry = &table.entries[table.count++];
+    *entry = {name, 0, 0, 0};
+    return entry;
+  }
+
+  // render side
+  void endBuffer() {
+    if (reportRequested.load(std::memory_order_relaxed)) {
+      reportRequested.store(false, std::memory_order_relaxed);
+      reports.write() = table;
+      reports.publish();
+      table.reset();
+    }
+  }
+
+  // reporting side
+  void requestReport() {
+    reportRequested.store(true, std::memory_order_relaxed);
+  }
+
+  // reporting side: true once the requested report is ready for printReport()
+  bool acquireReport() {
+    return reports.acquire();
+  }
+
+  void printReport() {
+    reports.read().print();
+  }
+
+  ProfileTable table;
+
+  private:
+  std::atomic<bool> reportRequested;
+  StateChannel<ProfileTable> reports;
+};
+
+inline Profiler profiler;
+
+struct ProfileScope {
+  ProfileScope(ProfileEntry* entry) : entry{entry}, start{readProfileTime()} {}
+
+  ~ProfileScope() {
+    ProfileTime elapsed = readProfileTime() - start;
+    if (!entry) {
+      return;
+    }
+    entry->calls++;
+    entry->total += elapsed;
+    if (elapsed > entry->max) {
+      entry->max = elapsed;
+    }
+  }
+
+  ProfileEntry* entry;
+  ProfileTime start;
+};
+
+}  // namespace platform
+
+#define PROFILE_CONCAT_(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_(a, b)
+
+#ifdef PLATFORM_PROFILE
+// the entry only gets looked up the first time each probe runs
+#define PROFILE_SCOPE(name)                                                              \
+  static platform::ProfileEntry* PROFILE_CONCAT(profileEntry, __LINE__) =                \
+    platform::profiler.getEntry(name);                                                   \
+  platform::ProfileScope PROFILE_CONCAT(profileScope, __LINE__)(                         \
+    PROFILE_CONCAT(profileEntry, __LINE__))
+#else
+#define PROFILE_SCOPE(name)
+#endif
+
+#endif  // PLATFORM_PROFILE_H
@@ -10,24 +10,174 @@
 #define SCALE_MELODIC_MINOR 5
 #define SCALE_PENTATONIC_MAJOR 6
 #define SCALE_PENTATONIC_MINOR 7
-// maybe the blues scale, whole tone scale or diminished scale, although those
-// are rarely used.
+// rarely used, so none of the instruments' scale knobs reach these
+#define SCALE_BLUES 8
+#define SCALE_WHOLE_TONE 9
+#define SCALE_DIMINISHED 10
 
+#include <stdint.h>
+
+#include "pitch.hpp"
+
+/*
+The note, scale and chord tables. They're constexpr, so the compiler works
+them out, there's only one of each however many files include this, and
+they're const, which on the Pico keeps them in flash. Define
+PLATFORM_TABLE_SECTION to put them somewhere else, e.g.
+__not_in_flash("tables") for RAM when a flash cache miss is too slow.
+*/
+#ifndef PLATFORM_TABLE_SECTION
+#define PLATFORM_TABLE_SECTION
+#endif
 
 namespace platform {
 
-// chords as semitone offsets from the root note
-int majorChordOffsets[] = {0, 4, 7};
-int minorChordOffsets[] = {0, 3, 7};
-int diminishedChordOffsets[] = {0, 3, 6};
-int augmentedChordOffsets[] = {0, 4, 8};
+const int numNotes = 88;
+
+// A0 to C8, the keys of a piano (76+12 = 88)
+struct NoteTable {
+  constexpr NoteTable() : frequencies{} {
+    for (int i = 0; i < numNotes; i++) {
+      // whole octaves up from A0 and then semitones within the octave
+      float octave = lowestNoteFrequency * (float)(1 << (i / 12));
+      frequencies[i] = (float)(octave * constexprExp2((i % 12) / 12.0));
+    }
+  }
+
+  constexpr float operator[](int note) const {
+    return frequencies[note];
+  }
+
+  float frequencies[numNotes];
+};
+
+PLATFORM_TABLE_SECTION inline constexpr NoteTable notes;
+
+enum ChordType { CHORD_MAJOR, CHORD_MINOR, CHORD_DIMINISHED, CHORD_AUGMENTED, CHORD_LAST };
+
+// chords as semitone offsets from the root note, by ChordType
+PLATFORM_TABLE_SECTION inline constexpr int8_t chordOffsets[CHORD_LAST][3] = {
+  {0, 4, 7},
+  {0, 3, 7},
+  {0, 3, 6},
+  {0, 4, 8},
+};
 // other chords are more situational, probably not as easily fit into chord
 // scales in a robotic way.
 
+const int maxScaleNotes = 12;
+
+// where an amount (see quantizeAmount()) or a semitone lands in a scale
+struct QuantizedNote {
+  // up (or down) from the root
+  int8_t semitones;
+  // which note of the scale it is
+  uint8_t degree;
+  // the ChordType on that note
+  uint8_t chord;
+};
+
+// amounts go up to 2 octaves either way in the biggest scale
+const int maxScaleOffset = 2 * maxScaleNotes;
 
 /*
-scales
-0 unquantized
+A scale: the semitones of its notes up from the root within an octave, and the
+ChordType of the chord on each of its notes. The chords go round again past
+the last one, like the notes do an octave up.
+
+Everything quantizing to it can ask for is worked out beforehand into the
+dense maps, so that's one table read at runtime: byAmount for the steps
+through the scale an amount makes (see quantizeAmount()), and bySemitone for
+the nearest note of the scale to each semitone of the octave.
+*/
+struct ScaleInfo {
+  int8_t offsets[maxScaleNotes];
+  uint8_t size;
+  uint8_t chords[maxScaleNotes];
+  // up and down, by how many steps
+  QuantizedNote byAmount[2][maxScaleOffset + 1];
+  QuantizedNote bySemitone[12];
+};
+
+template <size_t size, size_t chordCount>
+constexpr ScaleInfo makeScale(const int8_t (&offsets)[size], const uint8_t (&chordScale)[chordCount]) {
+  static_assert(size <= maxScaleNotes);
+  ScaleInfo scale{};
+  for (size_t i = 0; i < size; i++) {
+    scale.offsets[i] = offsets[i];
+  }
+  scale.size = size;
+  for (size_t i = 0; i < maxScaleNotes; i++) {
+    scale.chords[i] = chordScale[i % chordCount];
+  }
+
+  for (int isDown = 0; isDown < 2; isDown++) {
+    for (int steps = 0; steps <= maxScaleOffset; steps++) {
+      QuantizedNote& note = scale.byAmount[isDown][steps];
+      // whole octaves and then the note within the octave
+      int semitones = steps / (int)size * 12 + offsets[steps % size];
+      note.semitones = isDown ? -semitones : semitones;
+
+      /*
+      so let's say it is the c major scale. There are 7 notes in the scale. If we
+      go up 7 positions then we're back on c, just one octave higher.
+      Going up one step one degree takes you to d. Going down one step takes you to b.
+
+      We don't care what octave you land on, we're only interested in which
+      position in the scale it is so we can map the chord type.
+      */
+      int position = steps % size;
+      if (isDown) {
+        position = size - position;
+      }
+      note.degree = 0;
+      for (size_t i = 0; i < size; i++) {
+        if (position == offsets[i]) {
+          note.degree = i;
+          break;
+        }
+      }
+      note.chord = scale.chords[note.degree];
+    }
+  }
+
+  // the nearest note, the lower one if it's halfway, or the root an octave up
+  for (int semitone = 0; semitone < 12; semitone++) {
+    int nearest = 0;
+    int nearestDistance = 12;
+    // size is the root an octave up
+    for (size_t i = 0; i <= size; i++) {
+      int offset = i < size ? offsets[i] : 12;
+      int distance = offset > semitone ? offset - semitone : semitone - offset;
+      if (distance < nearestDistance) {
+        nearest = i;
+        nearestDistance = distance;
+      }
+    }
+    QuantizedNote& note = scale.bySemitone[semitone];
+    note.semitones = nearest < (int)size ? offsets[nearest] : 12;
+    note.degree = nearest < (int)size ? nearest : 0;
+    note.chord = scale.chords[note.degree];
+  }
+  return scale;
+}
+
+// chord scales as major (0) vs minor (1) vs diminished (2) vs augmented (3)
+// chord of the note at that point in the scale
+constexpr uint8_t majorChordScale[] = {0, 1, 1, 0, 0, 1, 2};
+constexpr uint8_t naturalMinorChordScale[] = {1, 2, 0, 1, 1, 0, 0};
+constexpr uint8_t harmonicMinorChordScale[] = {1, 2, 3, 1, 0, 0, 2};
+constexpr uint8_t melodicMinorChordScale[] = {1, 1, 3, 0, 0, 2, 2};
+// i, bIII, iv, the flat 5th and v, bVII
+constexpr uint8_t bluesChordScale[] = {1, 0, 1, 2, 1, 0};
+// every note of these is the same distance from the next, and so is every
+// chord
+constexpr uint8_t wholeToneChordScale[] = {3};
+constexpr uint8_t diminishedChordScale[] = {2};
+
+/*
+scales by their SCALE_ number
+0 unquantized (only for chords, like chromatic)
 1 chromatic
 2 major
 3 natural minor
@@ -35,156 +185,44 @@ scales
 5 melodic minor
 6 pentatonic major
 7 pentatonic minor
+8 blues
+9 whole tone
+10 diminished
 */
-int chromaticOffsets[] = {0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11};
-int majorOffsets[] = {0, 2, 4, 5, 7, 9, 11};
-int naturalMinorOffsets[] = {0, 2, 3, 5, 7, 8, 10};
-int harmonicMinorOffsets[] = {0, 2, 3, 5, 7, 8, 11};
-int melodicMinorOffsets[] = {0, 2, 3, 5, 7, 9, 11};
-// pentatonic major skips 5 and 11 from major scale
-int pentatonicMajorOffsets[] = {0, 2, 4, 7, 9};
-// pentatonic minor skips 2 and 8 from the natural minor scale
-int pentatonicMinorOffsets[] = {0, 3, 5, 7, 10};
-
-// chord scales as major (0) vs minor (1) vs diminished (2) vs augmented (3)
-// chord of the note at that point in the scale
-int majorChordScale[] = {0, 1, 1, 0, 0, 1, 2};
-int naturalMinorChordScale[] = {1, 2, 0, 1, 1, 0, 0};
-int harmonicMinorChordScale[] = {1, 2, 3, 1, 0, 0, 2};
-int melodicMinorChordScale[] = {1, 1, 3, 0, 0, 2, 2};
-
-// 76+12 = 88
-float notes[] = {
-  /*A0*/ 27.5,
-  /*A♯0/B♭0*/ 29.13524,
-  /*B0*/ 30.86771,
-  /*C1*/ 32.7032,
-  /*C♯1/D♭1*/ 34.64783,
-  /*D1*/ 36.7081,
-  /*D♯1/E♭1*/ 38.89087,
-  /*E1*/ 41.20344,
-  /*F1*/ 43.65353,
-  /*F♯1/G♭1*/ 46.2493,
-  /*G1*/ 48.99943,
-  /*G♯1/A♭1*/ 51.91309,
-  /*A1*/ 55.f,
-  /*A♯1/B♭1*/ 58.27047,
-  /*B1*/ 61.73541,
-  /*C2*/ 65.40639,
-  /*C♯2/D♭2*/ 69.29566,
-  /*D2*/ 73.41619,
-  /*D♯2/E♭2*/ 77.78175,
-  /*E2*/ 82.40689,
-  /*F2*/ 87.30706,
-  /*F♯2/G♭2*/ 92.49861,
-  /*G2*/ 97.99886,
-  /*G♯2/A♭2*/ 103.8262,
-  /*A2*/ 110.f,
-  /*A♯2/B♭2*/ 116.5409,
-  /*B2*/ 123.4708,
-  /*C3*/ 130.8128,
-  /*C♯3/D♭3*/ 138.5913,
-  /*D3*/ 146.8324,
-  /*D♯3/E♭3*/ 155.5635,
-  /*E3*/ 164.8138,
-  /*F3*/ 174.6141,
-  /*F♯3/G♭3*/ 184.9972,
-  /*G3*/ 195.9977,
-  /*G♯3/A♭3*/ 207.6523,
-  /*A3*/ 220.f,
-  /*A♯3/B♭3*/ 233.0819,
-  /*B3*/ 246.9417,
-  /*C4*/ 261.6256,
-  /*C♯4/D♭4*/ 277.1826,
-  /*D4*/ 293.6648,
-  /*D♯4/E♭4*/ 311.127,
-  /*E4*/ 329.6276,
-  /*F4*/ 349.2282,
-  /*F♯4/G♭4*/ 369.9944,
-  /*G4*/ 391.9954,
-  /*G♯4/A♭4*/ 415.3047,
-  /*A4*/ 440.f,
-  /*A♯4/B♭4*/ 466.1638,
-  /*B4*/ 493.8833,
-  /*C5*/ 523.2511,
-  /*C♯5/D♭5*/ 554.3653,
-  /*D5*/ 587.3295,
-  /*D♯5/E♭5*/ 622.254,
-  /*E5*/ 659.2551,
-  /*F5*/ 698.4565,
-  /*F♯5/G♭5*/ 739.9888,
-  /*G5*/ 783.9909,
-  /*G♯5/A♭5*/ 830.6094,
-  /*A5*/ 880.f,
-  /*A♯5/B♭5*/ 932.3275,
-  /*B5*/ 987.7666,
-  /*C6*/ 1046.502,
-  /*C♯6/D♭6*/ 1108.731,
-  /*D6*/ 1174.659,
-  /*D♯6/E♭6*/ 1244.508,
-  /*E6*/ 1318.51,
-  /*F6*/ 1396.913,
-  /*F♯6/G♭6*/ 1479.978,
-  /*G6*/ 1567.982,
-  /*G♯6/A♭6*/ 1661.219,
-  /*A6*/ 1760.f,
-  /*A♯6/B♭6*/ 1864.655,
-  /*B6*/ 1975.533,
-  /*C7*/ 2093.005,
-  /*C♯7/D♭7*/ 2217.461,
-  /*D7*/ 2349.318,
-  /*D♯7/E♭7*/ 2489.016,
-  /*E7*/ 2637.02,
-  /*F7*/ 2793.826,
-  /*F♯7/G♭7*/ 2959.955,
-  /*G7*/ 3135.963,
-  /*G♯7/A♭7*/ 3322.438,
-  /*A7*/ 3520.f,
-  /*A♯7/B♭7*/ 3729.31,
-  /*B7*/ 3951.066,
-  /*C8*/ 4186.009};
-
-
-float getFrequencyForNote(int scale, float note) {
-  int noteIndex = (int)note;
-  float noteFraction = note - noteIndex;
-  float value = notes[noteIndex];
+PLATFORM_TABLE_SECTION inline constexpr ScaleInfo scales[] = {
+  makeScale({0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11}, majorChordScale),
+  makeScale({0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11}, majorChordScale),
+  makeScale({0, 2, 4, 5, 7, 9, 11}, majorChordScale),
+  makeScale({0, 2, 3, 5, 7, 8, 10}, naturalMinorChordScale),
+  makeScale({0, 2, 3, 5, 7, 8, 11}, harmonicMinorChordScale),
+  makeScale({0, 2, 3, 5, 7, 9, 11}, melodicMinorChordScale),
+  // pentatonic major skips 5 and 11 from major scale
+  makeScale({0, 2, 4, 7, 9}, majorChordScale),
+  // pentatonic minor skips 2 and 8 from the natural minor scale
+  makeScale({0, 3, 5, 7, 10}, majorChordScale),
+  // pentatonic minor with the flat 5th
+  makeScale({0, 3, 5, 6, 7, 10}, bluesChordScale),
+  makeScale({0, 2, 4, 6, 8, 10}, wholeToneChordScale),
+  // whole step, half step
+  makeScale({0, 2, 3, 5, 6, 8, 9, 11}, diminishedChordScale),
+};
 
-  if (!scale) {
-    // TODO: this should probably be some kind of curve rather than linear
-    value = value + (notes[noteIndex + 1] - notes[noteIndex]) * noteFraction;
-  }
+const int numScales = sizeof(scales) / sizeof(scales[0]);
 
-  return value;
+// unknown scales are chromatic
+constexpr const ScaleInfo& getScale(int scale) {
+  return scales[scale >= 0 && scale < numScales ? scale : SCALE_CHROMATIC];
 }
 
-int getScaleNotesForScale(int scale, int** scaleNotes) {
-  switch (scale) {
-    case SCALE_MAJOR:
-      *scaleNotes = majorOffsets;
-      return sizeof(majorOffsets) / sizeof(int);
-    case SCALE_NATURAL_MINOR:
-      *scaleNotes = naturalMinorOffsets;
-      return sizeof(naturalMinorOffsets) / sizeof(int);
-    case SCALE_HARMONIC_MINOR:
-      *scaleNotes = harmonicMinorOffsets;
-      return sizeof(harmonicMinorOffsets) / sizeof(int);
-    case SCALE_MELODIC_MINOR:
-      *scaleNotes = melodicMinorOffsets;
-      return sizeof(melodicMinorOffsets) / sizeof(int);
-    case SCALE_PENTATONIC_MAJOR:
-      *scaleNotes = pentatonicMajorOffsets;
-      return sizeof(pentatonicMajorOffsets) / sizeof(int);
-    case SCALE_PENTATONIC_MINOR:
-      *scaleNotes = pentatonicMinorOffsets;
-      return sizeof(pentatonicMinorOffsets) / sizeof(int);
-    default:
-      *scaleNotes = chromaticOffsets;
-      return sizeof(chromaticOffsets) / sizeof(int);
+inline float getFrequencyForNote(int scale, float note) {
+  if (!scale) {
+    return pitchToFrequency(note);
   }
+
+  return notes[(int)note];
 }
 
-int getScaleOffsetForNote(float amount, int numScaleNotes) {
+inline int getScaleOffsetForNote(float amount, int numScaleNotes) {
   /*
   amount is -1 to 1. We're multiplying numScaleNotes by 0 to 1, rounding to the closest integer.
   assuming major scale: scaleOffset 0 means it returns the root note, 7 means it
@@ -194,96 +232,54 @@ int getScaleOffsetForNote(float amount, int numScaleNotes) {
   return scaleOffset;
 }
 
-float getSemitoneOffsetForNote(int scale, float amount) {
-  if (scale) {
-    int* scaleNotes;
-    int numScaleNotes = getScaleNotesForScale(scale, &scaleNotes);
-    int scaleOffset = getScaleOffsetForNote(amount, numScaleNotes);
-
-    int semitoneOffset = 0;
+// An amount from -1 to 1 as steps through 2 octaves of the scale either way,
+// for a quantized scale
+inline const QuantizedNote& quantizeAmount(int scale, float amount) {
+  const ScaleInfo& scaleInfo = getScale(scale);
+  int scaleOffset = getScaleOffsetForNote(amount, scaleInfo.size);
+  if (scaleOffset > maxScaleOffset) {
+    scaleOffset = maxScaleOffset;
+  }
+  return scaleInfo.byAmount[amount < 0.f][scaleOffset];
+}
 
-    while (scaleOffset >= numScaleNotes) {
-      scaleOffset -= numScaleNotes;
-      semitoneOffset += 12;
-    }
-    //{0, 2, 3, 5, 7, 9, 11}
-    semitoneOffset += scaleNotes[scaleOffset];
+// the nearest note of the scale to any number of semitones from the root
+inline QuantizedNote quantizeSemitones(int scale, int semitones) {
+  // the octave rounded down, also for negative ones
+  int octave = (semitones >= 0 ? semitones : semitones - 11) / 12;
+  QuantizedNote note = getScale(scale).bySemitone[semitones - octave * 12];
+  note.semitones += octave * 12;
+  return note;
+}
 
-    if (amount < 0.f) {
-      return -semitoneOffset;
-    }
-    return semitoneOffset;
+inline float getSemitoneOffsetForNote(int scale, float amount) {
+  if (scale) {
+    return quantizeAmount(scale, amount).semitones;
   } else {
     return amount * 24.f;
   }
 }
 
-int getChordScaleDegreeForNote(int scale, float amount) {
+inline int getChordScaleDegreeForNote(int scale, float amount) {
   if (scale) {
-    int* scaleNotes;
-    int numScaleNotes = getScaleNotesForScale(scale, &scaleNotes);
-    int scaleOffset = getScaleOffsetForNote(amount, numScaleNotes);
-
-    /*
-    so let's say it is the c major scale. There are 7 notes in the scale. If we
-    go up 7 positions then we're back on c, just one octave higher.
-    Going up one step one degree takes you to d. Going down one step takes you to b.
-
-    We don't care what octave you land on, we're only interested in which
-    position in the scale it is so we can map the chord type.
-    */
-    while (scaleOffset >= numScaleNotes) {
-      scaleOffset -= numScaleNotes;
-    }
-    if (amount < 0.f) {
-      scaleOffset = numScaleNotes - scaleOffset;
-    }
-
-    for (int i = 0; i < numScaleNotes; i++) {
-      if (scaleOffset == scaleNotes[i]) {
-        return i;
-      }
-    }
-    return 0;
-
+    return quantizeAmount(scale, amount).degree;
   } else {
     // TODO: this only makes sense for scales
     return 0;
   }
 }
 
-int getChordTypeForNote(int scale, int degree) {
-  switch (scale) {
-    case SCALE_MAJOR:
-      return majorChordScale[degree];
-    case SCALE_NATURAL_MINOR:
-      return naturalMinorChordScale[degree];
-    case SCALE_HARMONIC_MINOR:
-      return harmonicMinorChordScale[degree];
-    case SCALE_MELODIC_MINOR:
-      return melodicMinorChordScale[degree];
-    default:
-      return majorChordScale[degree];
-  }
+// the ChordType on a degree of the scale
+inline int getChordTypeForNote(int scale, int degree) {
+  return getScale(scale).chords[degree % maxScaleNotes];
 }
 
-float addSemitonesToFrequency(float frequency, float semitones) {
-  return frequency * powf(2.f, semitones / 12.f);
+inline float addSemitonesToFrequency(float frequency, float semitones) {
+  return frequency * semitonesToRatio(semitones);
 }
 
-int* getChordOffsetsForType(int chordType) {
-  switch (chordType) {
-    case 0:
-      return majorChordOffsets;
-    case 1:
-      return minorChordOffsets;
-    case 2:
-      return diminishedChordOffsets;
-    case 3:
-      return augmentedChordOffsets;
-    default:
-      return majorChordOffsets;
-  }
+inline const int8_t* getChordOffsetsForType(int chordType) {
+  return chordOffsets[chordType >= 0 && chordType < CHORD_LAST ? chordType : CHORD_MAJOR];
 }
 
 struct NoteQuantizer {
@@ -0,0 +1,103 @@
+#ifndef PLATFORM_RANDOM_H
+#define PLATFORM_RANDOM_H
+
+#include <math.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+#include <utility>
+
+namespace platform {
+
+/*
+A small random number generator for the audio path instead of rand(), which
+takes a lock and a call into the C library, and std::mt19937, which carries
+~5KB of state. This is PCG32 (pcg-random.org): 16 bytes of state (8 of them
+the stream) and a 64 bit multiply-add per number, with 2^63 separate streams
+to pick from. Every instrument owns the ones it needs and seeds them from
+get_rand_32() in init(), so what comes out only depends on that seed and on
+the instrument, not on what else has asked for numbers in between (which is
+what makes the host renders reproducible).
+
+It has the members std::shuffle() and the std distributions need, but
+shuffle() below is cheaper and comes out the same everywhere.
+*/
+class Random {
+  public:
+  using result_type = uint32_t;
+
+  Random(uint64_t seed = 0, uint64_t stream = 0) {
+    this->seed(seed, stream);
+  }
+
+  // streams with different numbers give different sequences for the same seed
+  void seed(uint64_t seed, uint64_t stream = 0) {
+    state = 0;
+    increment = (stream << 1) | 1;
+    next();
+    state += seed;
+    next();
+  }
+
+  uint32_t next() {
+    uint64_t old = state;
+    state = old * 6364136223846793005ull + increment;
+    uint32_t shifted = (uint32_t)(((old >> 18) ^ old) >> 27);
+    uint32_t rotation = (uint32_t)(old >> 59);
+    return (shifted >> rotation) | (shifted << ((-rotation) & 31));
+  }
+
+  // 0 to bound - 1, off by at most bound / 2^32 from even, which is nothing
+  // for the sizes here
+  uint32_t nextBelow(uint32_t bound) {
+    return (uint32_t)(((uint64_t)next() * bound) >> 32);
+  }
+
+  // 0 to 1, not including 1 (a float only has 24 bits of mantissa)
+  float nextFloat() {
+    return (next() >> 8) * (1.f / (1 << 24));
+  }
+
+  // -1 to 1, not including 1
+  float nextBipolar() {
+    return (int32_t)(next() & 0xffffff00) * (1.f / 2147483648.f);
+  }
+
+  // normally distributed with a mean of 0 and a standard deviation of 1, with
+  // the Box-Muller transform. Not for every sample, it's a log, a sqrt and a
+  // cos.
+  float nextGaussian() {
+    // 1 - x so it never takes the log of 0
+    float u1 = 1.f - nextFloat();
+    float u2 = nextFloat();
+    return sqrtf(-2.f * logf(u1)) * cosf(6.28318531f * u2);
+  }
+
+  // Fisher-Yates
+  template <typename T>
+  void shuffle(T* values, size_t count) {
+    for (size_t i = count; i > 1; i--) {
+      std::swap(values[i - 1], values[nextBelow(i)]);
+    }
+  }
+
+  uint32_t operator()() {
+    return next();
+  }
+
+  static constexpr uint32_t min() {
+    return 0;
+  }
+
+  static constexpr uint32_t max() {
+    return UINT32_MAX;
+  }
+
+  private:
+  uint64_t state;
+  uint64_t increment;
+};
+
+}  // namespace platform
+
+#endif  // PLATFORM_RANDOM_H
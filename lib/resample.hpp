@@ -0,0 +1,278 @@
+#ifndef PLATFORM_RESAMPLE_H
+#define PLATFORM_RESAMPLE_H
+
+#include <stdint.h>
+#include <sys/types.h>
+
+#include <array>
+#include <type_traits>
+
+#include "fixed.hpp"
+#include "profile.hpp"
+
+namespace platform {
+
+/*
+Half-band FIR filters for going up to 2 or 4 times the sample rate and back
+down a block at a time, so the nonlinear parts of a voice (the ladder filter's
+clipper, an overdrive, oscillators that alias) can run oversampled without the
+harmonics they make above the Nyquist frequency folding back down. A hard
+driven clipper at 4x with linear interpolation and averaging (what
+LadderFilter does) still aliases at -20dB, with these it's -40dB at 2x and
+-63dB at 4x (platform16_bench -f aliasing).
+
+A half-band filter's response is symmetric around a quarter of the rate it
+runs at, which makes every other tap 0 apart from the middle one, which is 0.5.
+Split into the even and the odd samples (polyphase), one of the two is just a
+delay and the other a symmetric FIR with half the taps, so every pair of
+samples at the higher rate costs one multiply per coefficient below (the two
+samples that share one get added first). Going up, the new samples in between
+get worked out and the old ones come out as they were. Going down, only the
+samples that are kept get worked out.
+
+The coefficients are Kaiser windowed sincs, the taps on one side of the middle
+one from the nearest out. Sample is float, or q27 with the coefficients in Q30.
+*/
+
+// For between the sample rate and twice that: passes up to 0.4 of the lower
+// rate (9.6kHz at 24kHz) and takes ~50dB off from 0.6 of it, so only what's
+// between 0.5 and 0.6 folds back, and only above 0.4. 31 taps, 8 multiplies.
+struct HalfBand31 {
+  static constexpr uint taps = 8;
+  static constexpr float coefficients[taps] = {
+    3.157311286e-01f, -9.802037095e-02f, 5.084189340e-02f, -2.891425670e-02f,
+    1.625254943e-02f, -8.484506918e-03f, 3.808300655e-03f, -1.214737525e-03f,
+  };
+};
+
+// For between twice and 4 times the sample rate, the second stage of going up
+// or the first of going down 4x. Everything above 0.4 of the sample rate has
+// gone (or will be), which leaves it a much wider transition: passes up to 0.1
+// of the rate it runs at and takes ~65dB off from 0.4. 15 taps, 4 multiplies.
+struct HalfBand15 {
+  static constexpr uint taps = 4;
+  static constexpr float coefficients[taps] = {
+    2.992385382e-01f, -5.973774928e-02f, 1.092679889e-02f, -4.275877835e-04f,
+  };
+};
+
+// The last few samples, newest first, without shuffling them along: every
+// sample gets written twice, length apart, so the newest length of them are
+// always in one piece.
+template <uint length, typename Sample>
+struct HalfBandDelay {
+  void init() {
+    for (uint i = 0; i < 2 * length; i++) {
+      samples[i] = 0;
+    }
+    position = 0;
+  }
+
+  const Sample* push(Sample sample) {
+    position = (position ? position : length) - 1;
+    samples[position] = sample;
+    samples[position + length] = sample;
+    return &samples[position];
+  }
+
+  Sample samples[2 * length];
+  uint position;
+};
+
+// the bits HalfBandUpsampler and HalfBandDownsampler share
+template <typename Design, typename Sample>
+struct HalfBandFilter {
+  static constexpr bool isFixed = !std::is_floating_point_v<Sample>;
+  static constexpr uint taps = Design::taps;
+  // the newest 2 * taps samples at the lower rate cover all of the taps
+  using Delay = HalfBandDelay<2 * taps, Sample>;
+
+  // the coefficients times gain, in Q30 for the fixed point ones
+  static constexpr std::array<Sample, taps> getCoefficients(float gain) {
+    std::array<Sample, taps> coefficients{};
+    for (uint i = 0; i < taps; i++) {
+      if constexpr (isFixed) {
+        coefficients[i] = floatToFixed<30>(Design::coefficients[i] * gain);
+      } else {
+        coefficients[i] = Design::coefficients[i] * gain;
+      }
+    }
+    return coefficients;
+  }
+
+  // the taps either side of the middle one, for the newest samples first
+  static Sample convolve(const Sample* samples, const std::array<Sample, taps>& coefficients) {
+    Sample sum = 0;
+#pragma GCC unroll 8
+    for (uint i = 0; i < taps; i++) {
+      Sample pair = samples[taps - 1 - i] + samples[taps + i];
+      if constexpr (isFixed) {
+        sum += mulShift<30>(pair, coefficients[i]);
+      } else {
+        sum += pair * coefficients[i];
+      }
+    }
+    return sum;
+  }
+};
+
+// twice the sample rate
+template <typename Design, typename Sample = float>
+class HalfBandUpsampler {
+  using Filter = HalfBandFilter<Design, Sample>;
+
+  public:
+  void init() {
+    delay.init();
+  }
+
+  // count samples from in make 2 * count in out, which can't be in
+  void process(const Sample* in, Sample* out, size_t count) {
+    for (size_t i = 0; i < count; i++) {
+      const Sample* samples = delay.push(in[i]);
+      out[2 * i] = Filter::convolve(samples, coefficients);
+      out[2 * i + 1] = samples[Filter::taps - 1];
+    }
+  }
+
+  private:
+  // doubled, half the samples going in are zeros
+  static constexpr std::array<Sample, Filter::taps> coefficients = Filter::getCoefficients(2.f);
+
+  typename Filter::Delay delay;
+};
+
+// half the sample rate
+template <typename Design, typename Sample = float>
+class HalfBandDownsampler {
+  using Filter = HalfBandFilter<Design, Sample>;
+
+  public:
+  void init() {
+    evens.init();
+    odds.init();
+  }
+
+  // 2 * count samples from in make count in out, which can be in
+  void process(const Sample* in, Sample* out, size_t count) {
+    for (size_t i = 0; i < count; i++) {
+      const Sample* evenSamples = evens.push(in[2 * i]);
+      const Sample* oddSamples = odds.push(in[2 * i + 1]);
+      // the middle tap
+      Sample odd = oddSamples[Filter::taps];
+      if constexpr (Filter::isFixed) {
+        odd >>= 1;
+      } else {
+        odd *= 0.5f;
+      }
+      out[i] = Filter::convolve(evenSamples, coefficients) + odd;
+    }
+  }
+
+  private:
+  static constexpr std::array<Sample, Filter::taps> coefficients = Filter::getCoefficients(1.f);
+
+  typename Filter::Delay evens, odds;
+};
+
+// for the stage 2x doesn't need
+struct NoResampler {
+  void init() {}
+};
+
+// factor (2 or 4) times the sample rate, with a HalfBand31 and then a
+// HalfBand15 for 4
+template <uint factor, typename Sample = float>
+class Upsampler {
+  static_assert(factor == 2 || factor == 4, "Upsampler factor has to be 2 or 4");
+
+  public:
+  void init() {
+    first.init();
+    second.init();
+  }
+
+  // count samples from in make factor * count in out, which can't be in
+  void process(const Sample* in, Sample* out, size_t count) {
+    if constexpr (factor == 2) {
+      first.process(in, out, count);
+    } else {
+      // The first stage goes into the second half of out, and the second one
+      // works from there to the start. It only ever writes over samples it's
+      // done with: by the time it's read sample i of the second half (at
+      // 2 * count + i) it's written up to 2 * i + 1.
+      Sample* half = out + 2 * count;
+      first.process(in, half, count);
+      second.process(half, out, 2 * count);
+    }
+  }
+
+  private:
+  HalfBandUpsampler<HalfBand31, Sample> first;
+  std::conditional_t<factor == 4, HalfBandUpsampler<HalfBand15, Sample>, NoResampler> second;
+};
+
+// 1 / factor of the sample rate, the same stages as Upsampler the other way
+// round
+template <uint factor, typename Sample = float>
+class Downsampler {
+  static_assert(factor == 2 || factor == 4, "Downsampler factor has to be 2 or 4");
+
+  public:
+  void init() {
+    first.init();
+    last.init();
+  }
+
+  // factor * count samples from in make count in out. The 4x one uses in for
+  // the samples in between, out can be in.
+  void process(Sample* in, Sample* out, size_t count) {
+    if constexpr (factor == 4) {
+      first.process(in, in, 2 * count);
+    }
+    last.process(in, out, count);
+  }
+
+  private:
+  std::conditional_t<factor == 4, HalfBandDownsampler<HalfBand15, Sample>, NoResampler> first;
+  HalfBandDownsampler<HalfBand31, Sample> last;
+};
+
+/*
+Runs something at factor times the sample rate: processBlock() upsamples the
+block, calls process(Sample* oversampled, size_t count) on it (up to chunkSize
+samples at a time, count is always a multiple of factor) to do its thing in
+place, and downsamples that back into the block.
+
+Going up and back down delays the block by 15 samples at 2x and about 19 at 4x.
+*/
+template <uint factor, typename Sample = float>
+class Oversampler {
+  public:
+  static const uint chunkSize = 32;
+
+  void init() {
+    upsampler.init();
+    downsampler.init();
+  }
+
+  template <typename Process>
+  void processBlock(Sample* buf, size_t size, Process&& process) {
+    PROFILE_SCOPE("resample");
+    for (size_t start = 0; start < size; start += chunkSize) {
+      size_t count = size - start < chunkSize ? size - start : chunkSize;
+      upsampler.process(buf + start, oversampled, count);
+      process(oversampled, count * factor);
+      downsampler.process(oversampled, buf + start, count);
+    }
+  }
+
+  private:
+  Upsampler<factor, Sample> upsampler;
+  Downsampler<factor, Sample> downsampler;
+  Sample oversampled[chunkSize * factor];
+};
+
+}  // namespace platform
+
+#endif  // PLATFORM_RESAMPLE_H
@@ -0,0 +1,347 @@
+#ifndef PLATFORM_SATURATION_H
+#define PLATFORM_SATURATION_H
+
+#include <math.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/types.h>
+
+#include "fixed.hpp"
+#include "profile.hpp"
+
+namespace platform {
+
+/*
+Saturation curves for the per-sample path. The tanh shaped ones come in three
+tiers of accuracy, each as a rational function (no memory, a division per
+sample) or as a table with linear interpolation (a few KB at most, no division):
+
+              rational          table
+  Low         ~2e-2 (softClip)  ~2e-3, 64 points
+  Medium      ~1e-3             ~1e-4, 256 points
+  High        ~1e-4             ~6e-6, 1024 points
+
+The numbers are the largest error against tanhf(), platform16_bench -f
+saturation measures them again.
+*/
+enum class SaturationAccuracy { Low, Medium, High };
+
+/** Soft Limiting function ported extracted from pichenettes/stmlib via daisysp*/
+inline float softLimit(float x) {
+  return x * (27.f + x * x) / (27.f + 9.f * x * x);
+}
+
+// Padé approximants of tanh, clipped where they reach 1 so they stay continuous
+template <SaturationAccuracy accuracy = SaturationAccuracy::Low>
+inline float tanhRational(float x) {
+  if constexpr (accuracy == SaturationAccuracy::Low) {
+    if (x > 3.0f)
+      return 1.0f;
+    if (x < -3.0f)
+      return -1.0f;
+    float x2 = x * x;
+    return x * (27.0f + x2) / (27.0f + 9.0f * x2);
+  } else if constexpr (accuracy == SaturationAccuracy::Medium) {
+    if (x > 3.6468f)
+      return 1.0f;
+    if (x < -3.6468f)
+      return -1.0f;
+    float x2 = x * x;
+    return x * (945.f + x2 * (105.f + x2)) / (945.f + x2 * (420.f + 15.f * x2));
+  } else {
+    if (x > 4.9718f)
+      return 1.0f;
+    if (x < -4.9718f)
+      return -1.0f;
+    float x2 = x * x;
+    return x * (135135.f + x2 * (17325.f + x2 * (378.f + x2))) /
+      (135135.f + x2 * (62370.f + x2 * (3150.f + 28.f * x2)));
+  }
+}
+
+// tanh from 0 to 8 (where it is within 2e-7 of 1), the other half is mirrored
+template <uint size>
+struct TanhTable {
+  static constexpr float range = 8.f;
+
+  TanhTable() {
+    for (uint i = 0; i <= size; i++) {
+      values[i] = tanhf(range * i / size);
+    }
+    // so process() doesn't need to check for the last point
+    values[size + 1] = values[size];
+  }
+
+  float process(float x) const {
+    float position = fabsf(x) * (size / range);
+    float out;
+    if (position >= size) {
+      out = 1.f;
+    } else {
+      uint index = (uint)position;
+      float fraction = position - index;
+      out = values[index] + (values[index + 1] - values[index]) * fraction;
+    }
+    return x < 0.f ? -out : out;
+  }
+
+  float values[size + 2];
+};
+
+template <SaturationAccuracy accuracy>
+constexpr uint tanhTableSize = accuracy == SaturationAccuracy::Low      ? 64
+                               : accuracy == SaturationAccuracy::Medium ? 256
+                                                                        : 1024;
+
+// filled in before main(), and only if something uses that tier
+template <SaturationAccuracy accuracy>
+inline const TanhTable<tanhTableSize<accuracy>> tanhTable;
+
+template <SaturationAccuracy accuracy = SaturationAccuracy::Medium>
+inline float tanhLookup(float x) {
+  return tanhTable<accuracy>.process(x);
+}
+
+/** Soft Clipping function extracted from pichenettes/stmlib via daisysp */
+inline float softClip(float x) {
+  PROFILE_SCOPE("softClip");
+  if (x < -3.0f)
+    return -1.0f;
+  else if (x > 3.0f)
+    return 1.0f;
+  else
+    return softLimit(x);
+}
+
+/*
+tanhRational() (the Low one, which is the same curve as softClip()) for Q27,
+from a table with linear interpolation. It reaches 1 at 3, so the table only
+needs to go up to 4. Within ~1.5e-6 of the float one. That takes 1024 points
+(4KB): FixedLadderFilter clips inside its feedback loop, and with 256 points
+(3e-5) a self-oscillating filter drifted away from the float one by 45dB SNR.
+*/
+struct FixedTanhTable {
+  static const uint sizeBits = 10;
+  static const uint size = 1 << sizeBits;
+  // 4 in Q27 is 1 << 29, the top sizeBits of those index the table
+  static const int indexShift = q27Bits + 2 - sizeBits;
+
+  FixedTanhTable() {
+    for (uint i = 0; i <= size; i++) {
+      values[i] = floatToQ27(tanhRational(4.f * i / size));
+    }
+  }
+
+  q27 process(q27 x) const {
+    uint32_t magnitude = x < 0 ? -(uint32_t)x : x;
+    uint32_t index = magnitude >> indexShift;
+    q27 out;
+    if (index >= size) {
+      out = q27One;
+    } else {
+      int32_t fraction = magnitude & ((1 << indexShift) - 1);
+      out = values[index] + mulShift<indexShift>(values[index + 1] - values[index], fraction);
+    }
+    return x < 0 ? -out : out;
+  }
+
+  q27 values[size + 1];
+};
+
+inline const FixedTanhTable fixedTanhTable;
+
+inline q27 tanhQ27(q27 x) {
+  return fixedTanhTable.process(x);
+}
+
+inline q27 softClipQ27(q27 x) {
+  PROFILE_SCOPE("softClip");
+  return fixedTanhTable.process(x);
+}
+
+/*
+The overdrive the instruments use: softClip() and then the magnitude raised to
+1 / (1 + amount * 2), which pushes quiet parts up more the higher the amount.
+
+That power used to be a powf() per sample. Now it comes from a table that only
+gets rebuilt when setAmount() gets a different amount. The table is indexed by
+the float's exponent and the top bits of its mantissa, so it is as accurate near
+zero (where the curve is steepest) as near 1. Because x^p = 2^(e*p) * m^p, it
+only needs the power of every mantissa step and of every octave, which makes
+rebuilding it about as cheap as the 16 powf() calls of one control block were.
+Within ~1e-4 of powf() (relative).
+*/
+struct Overdrive {
+  // octaves below 1 that get looked up, anything quieter is taken as linear
+  static const uint octaves = 32;
+  static const uint mantissaBits = 4;
+  static const uint mantissaSteps = 1 << mantissaBits;
+
+  Overdrive() : level{1.f}, levelRecip{1.f}, amount{-1.f} {
+    setAmount(0.f);
+  }
+
+  // The volume is the level the input gets scaled from before clipping, so
+  // that the overdrive doesn't make things much louder
+  void init(float volume) {
+    level = 1.f - volume;
+    levelRecip = level == 0.f ? 0.f : 1.f / level;
+  }
+
+  void setAmount(float newAmount) {
+    if (newAmount == amount) {
+      return;
+    }
+    amount = newAmount;
+
+    // times 2 is arbitrary
+    float exponent = 1.f / (1.f + amount * 2.f);
+    for (uint i = 0; i <= mantissaSteps; i++) {
+      mantissaPowers[i] = powf(1.f + (float)i / mantissaSteps, exponent);
+    }
+    float octavePower = exp2f(exponent);
+    octavePowers[octaves] = 1.f;
+    for (uint i = octaves; i > 0; i--) {
+      octavePowers[i - 1] = octavePowers[i] / octavePower;
+    }
+    belowScale = octavePowers[0] * exp2f((float)octaves);
+  }
+
+  float process(float sample) {
+    PROFILE_SCOPE("overdrive");
+    if (level == 0.f) {
+      return sample;
+    }
+
+    float in = softClip(sample * levelRecip);
+    float out = getPower(fabsf(in));
+    if (in < 0.f) {
+      out = -out;
+    }
+    return out * level;
+  }
+
+  // in^(1 / (1 + amount * 2)) for in from 0 to 1
+  float getPower(float in) const {
+    if (in >= 1.f) {
+      return 1.f;
+    }
+
+    uint32_t bits;
+    memcpy(&bits, &in, sizeof(bits));
+    int octave = (int)(bits >> 23) - 127 + (int)octaves;
+    if (octave < 0) {
+      return in * belowScale;
+    }
+
+    const uint fractionBits = 23 - mantissaBits;
+    uint32_t mantissa = bits & 0x7fffff;
+    uint step = mantissa >> fractionBits;
+    float fraction = (mantissa & ((1 << fractionBits) - 1)) * (1.f / (1 << fractionBits));
+    float power = mantissaPowers[step] + (mantissaPowers[step + 1] - mantissaPowers[step]) * fraction;
+    return power * octavePowers[octave];
+  }
+
+  float getAmount() const {
+    return amount;
+  }
+
+  private:
+  float level;
+  float levelRecip;
+  float amount;
+  float mantissaPowers[mantissaSteps + 1];
+  float octavePowers[octaves + 1];
+  // for below the lowest octave
+  float belowScale;
+};
+
+/*
+Overdrive for Q27 samples. The power table works the same way, but the octave
+comes from counting the leading zeros, and a Q27 below 1 only has 27 of them.
+*/
+struct FixedOverdrive {
+  static const uint octaves = q27Bits;
+  static const uint mantissaBits = 4;
+  static const uint mantissaSteps = 1 << mantissaBits;
+  static const int fractionBits = 31 - mantissaBits;
+
+  FixedOverdrive() : level{0}, levelRecip{0}, isBypassed{true}, amount{-1.f} {
+    setAmount(0.f);
+  }
+
+  // see Overdrive::init()
+  void init(float volume) {
+    isBypassed = volume >= 1.f;
+    level = floatToFixed<30>(1.f - volume);
+    levelRecip = isBypassed ? 0 : floatToFixed<28>(1.f / (1.f - volume));
+  }
+
+  void setAmount(float newAmount) {
+    if (newAmount == amount) {
+      return;
+    }
+    amount = newAmount;
+
+    float exponent = 1.f / (1.f + amount * 2.f);
+    for (uint i = 0; i <= mantissaSteps; i++) {
+      mantissaPowers[i] = floatToFixed<29>(powf(1.f + (float)i / mantissaSteps, exponent));
+    }
+    for (uint i = 0; i < octaves; i++) {
+      octavePowers[i] = floatToFixed<30>(exp2f(((float)i - octaves) * exponent));
+    }
+  }
+
+  q27 process(q27 sample) {
+    PROFILE_SCOPE("overdrive");
+    if (isBypassed) {
+      return sample;
+    }
+
+    q27 in = softClipQ27(mulShiftSat<28>(sample, levelRecip));
+    q27 out = getPower(in < 0 ? -in : in);
+    if (in < 0) {
+      out = -out;
+    }
+    return mulShift<30>(out, level);
+  }
+
+  // in^(1 / (1 + amount * 2)) for in from 0 to 1
+  q27 getPower(q27 in) const {
+    if (in >= q27One) {
+      return q27One;
+    }
+    if (in <= 0) {
+      return 0;
+    }
+
+    // in is 2^(octave - 27) times 1.mantissa
+    uint octave = 31 - __builtin_clz(in);
+    uint32_t mantissa = ((uint32_t)in << (31 - octave)) & 0x7fffffff;
+    uint step = mantissa >> fractionBits;
+    int32_t fraction = mantissa & ((1 << fractionBits) - 1);
+    int32_t power = mantissaPowers[step] +
+      mulShift<fractionBits>(mantissaPowers[step + 1] - mantissaPowers[step], fraction);
+    // Q29 times Q30
+    return mulShift<29 + 30 - q27Bits>(power, octavePowers[octave]);
+  }
+
+  float getAmount() const {
+    return amount;
+  }
+
+  private:
+  // Q30 and Q28
+  int32_t level;
+  int32_t levelRecip;
+  bool isBypassed;
+  float amount;
+  // Q29, they go up to 2
+  int32_t mantissaPowers[mantissaSteps + 1];
+  // Q30
+  int32_t octavePowers[octaves];
+};
+
+}  // namespace platform
+
+#endif  // PLATFORM_SATURATION_H
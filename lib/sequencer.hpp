@@ -2,18 +2,17 @@
 #define SEQUENCER_HPP
 
 #include <algorithm>
+#include <array>
 #include <cmath>
-#include <random>
 #include <utility>
-#include <vector>
 
+#include "random.hpp"
 
-#ifndef M_PI
-#define M_PI 3.1415927410125732421875f
-#endif
 
 namespace platform {
 
+// Everything lives in fixed size arrays in the object, so nothing allocates
+// when the sequence gets regenerated from process() in the audio path.
 class Sequencer {
 public:
   struct Step {
@@ -22,15 +21,20 @@ public:
   };
 
   Sequencer()
-    : sequence(kMaxSteps),
+    : sequence{},
       currentStep(0),
       sequenceLength(32),
       complexity(16),
       density(0.5f),
       spread(0.5f),
       bias(0.4f),
+      cvPalette{},
+      cvPaletteSize(0),
       cvSeed(0),
-      cvPaletteSeed(0) {
+      cvPaletteSeed(0),
+      isPaletteDirty(false),
+      areVoltagesDirty(false),
+      areGatesDirty(false) {
     // Initialize with default parameters
     regenerateCVPalette();
     regenerateControlVoltages();
@@ -39,6 +43,8 @@ public:
 
   // Main interface - returns gate and CV for current step and advances
   std::pair<bool, float> process() {
+    regenerateIfDirty();
+
     Step& step = sequence[currentStep];
     std::pair<bool, float> result = {step.gate, step.cv};
 
@@ -48,7 +54,9 @@ public:
     return result;
   }
 
-  // Parameter setters
+  // Parameter setters. They only note what needs regenerating, which happens
+  // on the next process(), so setting all of them every tick costs nothing
+  // unless something changed, and even then it only gets regenerated once.
 
   void setSequenceLength(int length) {
     if (length < 1 || length > kMaxSteps) {
@@ -62,28 +70,35 @@ public:
   }
 
   void setComplexity(int newComplexity) {
-    if (newComplexity < 1 || newComplexity > kMaxSteps) {
+    if (newComplexity < 1 || newComplexity > kMaxSteps || newComplexity == complexity) {
       return;
     }
     complexity = newComplexity;
-    regenerateCVPalette();
-    regenerateControlVoltages();
+    isPaletteDirty = true;
   }
 
   void setDensity(float newDensity) {
     if (newDensity < 0.0f || newDensity > 1.0f) {
       return;
     }
+    int numGates = calculateNumGates();
     density = newDensity;
-    regenerateGates();
+    // the gates only change with the number of them
+    if (calculateNumGates() != numGates) {
+      areGatesDirty = true;
+    }
   }
 
   void setSpread(float newSpread) {
     if (newSpread < 0.0f || newSpread > 1.0f) {
       return;
     }
+    int totalRuns = calculateTotalRuns();
     spread = newSpread;
-    regenerateControlVoltages();
+    // the voltages only change with the number of runs
+    if (calculateTotalRuns() != totalRuns) {
+      areVoltagesDirty = true;
+    }
   }
 
   void setBias(float newBias) {
@@ -91,11 +106,14 @@ public:
       return;
     }
     // Quantize to nearest 0.04 for reproducibility
-    bias = std::round(newBias / 0.04f) * 0.04f;
+    float quantizedBias = std::round(newBias / 0.04f) * 0.04f;
     // Clamp to ensure we stay in [0, 1] after quantization
-    bias = std::max(0.0f, std::min(1.0f, bias));
-    regenerateCVPalette();
-    regenerateControlVoltages();
+    quantizedBias = std::max(0.0f, std::min(1.0f, quantizedBias));
+    if (quantizedBias == bias) {
+      return;
+    }
+    bias = quantizedBias;
+    isPaletteDirty = true;
   }
 
   // Parameter getters
@@ -110,15 +128,20 @@ public:
 
   // Set seed for CV assignment reproducibility
   void setCVSeed(unsigned int seed) {
+    if (seed == cvSeed) {
+      return;
+    }
     cvSeed = seed;
-    regenerateControlVoltages();
+    areVoltagesDirty = true;
   }
 
   // Set seed for CV palette reproducibility
   void setCVPaletteSeed(unsigned int seed) {
+    if (seed == cvPaletteSeed) {
+      return;
+    }
     cvPaletteSeed = seed;
-    regenerateCVPalette();
-    regenerateControlVoltages();
+    isPaletteDirty = true;
   }
 
   // Reset to first step
@@ -130,7 +153,7 @@ private:
   static constexpr int kMaxSteps = 32;
 
   // Sequence data
-  std::vector<Step> sequence;
+  std::array<Step, kMaxSteps> sequence;
   int currentStep;
 
   // Parameters
@@ -140,17 +163,44 @@ private:
   float spread;        // 0-1
   float density;       // 0-1
 
-  // Control voltage palette
-  std::vector<float> cvPalette;
+  // Control voltage palette, the first cvPaletteSize of it
+  std::array<float, kMaxSteps> cvPalette;
+  int cvPaletteSize;
 
   // Random number generation seeds
   unsigned int cvSeed;
   unsigned int cvPaletteSeed;
+  // reseeded for every regeneration
+  Random rng;
+
+  // What the setters changed since the last process(). The palette changing
+  // means the voltages have to be redone too.
+  bool isPaletteDirty;
+  bool areVoltagesDirty;
+  bool areGatesDirty;
+
+  // The palette is the expensive one (random numbers, Box-Muller and a sort),
+  // the voltages take a shuffle and the gates next to nothing
+  void regenerateIfDirty() {
+    if (isPaletteDirty) {
+      isPaletteDirty = false;
+      regenerateCVPalette();
+      areVoltagesDirty = true;
+    }
+    if (areVoltagesDirty) {
+      areVoltagesDirty = false;
+      regenerateControlVoltages();
+    }
+    if (areGatesDirty) {
+      areGatesDirty = false;
+      regenerateGates();
+    }
+  }
 
   // Internal generation methods
   void regenerateGates() {
     // Calculate how many gates should be true
-    int numGates = static_cast<int>(std::round(density * kMaxSteps));
+    int numGates = calculateNumGates();
 
     // Reset all gates to false
     for (auto& step : sequence) {
@@ -194,39 +244,36 @@ private:
   }
 
   void regenerateCVPalette() {
-    cvPalette.clear();
-    cvPalette.reserve(complexity);
-
     // Use seeded RNG for reproducible palette generation
-    std::mt19937 paletteRng(cvPaletteSeed);
+    rng.seed(cvPaletteSeed);
 
-    for (int i = 0; i < complexity; ++i) {
-      cvPalette.push_back(generateBiasedCV(paletteRng));
+    cvPaletteSize = complexity;
+    for (int i = 0; i < cvPaletteSize; ++i) {
+      cvPalette[i] = generateBiasedCV(rng);
     }
 
     // Sort palette for consistent ordering
-    std::sort(cvPalette.begin(), cvPalette.end());
+    std::sort(cvPalette.begin(), cvPalette.begin() + cvPaletteSize);
   }
 
   void regenerateControlVoltages() {
-    if (cvPalette.empty()) {
+    if (!cvPaletteSize) {
       return;
     }
 
     int totalRuns = calculateTotalRuns();
 
-    // Create a list of CV indices to use
-    std::vector<int> cvIndices;
-    cvIndices.reserve(totalRuns);
+    // Create a list of CV indices to use, the first totalRuns of them
+    std::array<int, kMaxSteps> cvIndices;
 
     // Fill with palette indices, cycling if necessary
     for (int i = 0; i < totalRuns; ++i) {
-      cvIndices.push_back(i % complexity);
+      cvIndices[i] = i % complexity;
     }
 
     // Shuffle the CV indices for variety using seeded RNG for reproducibility
-    std::mt19937 cvRng(cvSeed);
-    std::shuffle(cvIndices.begin(), cvIndices.end(), cvRng);
+    rng.seed(cvSeed);
+    rng.shuffle(cvIndices.data(), totalRuns);
 
     // TODO: there could be two identical cv values next to each other which
     // would mean that two adjacent runs could be identical and therefore merge
@@ -265,15 +312,8 @@ private:
 
   // Helper methods
 
-  float generateBiasedCV(std::mt19937& rngToUse) {
-    // Use Box-Muller transform to generate Gaussian distribution
-    std::uniform_real_distribution<float> dist(0.0f, 1.0f);
-
-    float u1 = dist(rngToUse);
-    float u2 = dist(rngToUse);
-
-    // Box-Muller transform
-    float z0 = std::sqrt(-2.0f * std::log(u1)) * std::cos(2.0f * M_PI * u2);
+  float generateBiasedCV(Random& rngToUse) {
+    float z0 = rngToUse.nextGaussian();
 
     // Scale and shift based on bias (mean at bias, stddev of 0.2)
     // We'll use stddev of 0.2 to keep values mostly in range
@@ -283,6 +323,10 @@ private:
     return std::max(0.0f, std::min(1.0f, value));
   }
 
+  int calculateNumGates() const {
+    return static_cast<int>(std::round(density * kMaxSteps));
+  }
+
   int calculateTotalRuns() const {
     // At spread = 0: number of runs = complexity (one run per CV value)
     // At spread = 1: number of runs = kMaxSteps (CV changes every step)
@@ -0,0 +1,63 @@
+#ifndef PLATFORM_STATE_CHANNEL_H
+#define PLATFORM_STATE_CHANNEL_H
+
+#include <atomic>
+#include <stdint.h>
+
+namespace platform {
+
+/*
+Hands complete snapshots of a state from one producer (the controller) to one
+consumer (the audio path) without locks. It is a triple buffer: the producer
+always has a buffer of its own to write into, the consumer always has one of its
+own to read from, and the third one holds the newest published snapshot. Both
+sides only ever swap their buffer with that third one, so neither side waits and
+the consumer never sees a half written snapshot.
+
+The producer has to write the whole state into write() before every publish(),
+because the buffer it gets back can be an older snapshot. Works between the two
+cores as well as within one.
+*/
+template <typename T>
+struct StateChannel {
+  StateChannel() : writeIndex{0}, readIndex{1}, shared{2} {}
+
+  // producer: the buffer to write the next snapshot into
+  T& write() {
+    return buffers[writeIndex];
+  }
+
+  // producer: make what was written the newest snapshot
+  void publish() {
+    writeIndex = shared.exchange(writeIndex | freshBit, std::memory_order_acq_rel) & indexBits;
+  }
+
+  // consumer: switch to the newest snapshot if there is one since the last
+  // acquire(). Returns whether read() changed.
+  bool acquire() {
+    if (!(shared.load(std::memory_order_relaxed) & freshBit)) {
+      return false;
+    }
+    readIndex = shared.exchange(readIndex, std::memory_order_acq_rel) & indexBits;
+    return true;
+  }
+
+  // consumer: the snapshot from the last acquire()
+  const T& read() {
+    return buffers[readIndex];
+  }
+
+  private:
+  static const uint8_t indexBits = 3;
+  static const uint8_t freshBit = 4;
+
+  T buffers[3];
+  uint8_t writeIndex;
+  uint8_t readIndex;
+  // index of the third buffer, plus freshBit if it hasn't been acquired yet
+  std::atomic<uint8_t> shared;
+};
+
+}  // namespace platform
+
+#endif  // PLATFORM_STATE_CHANNEL_H
@@ -4,6 +4,8 @@
 
 #include <math.h>
 
+#include "saturation.hpp"
+
 #ifndef M_PI
 #define M_PI 3.1415927410125732421875f
 #endif
@@ -26,25 +28,6 @@ inline float scaleBipolar(float value) {
   return value * 2.f - 1.f;
 }
 
-inline float randomProb() {
-  return ((float)rand()) / RAND_MAX;
-}
-
-/** Soft Limiting function ported extracted from pichenettes/stmlib via daisysp*/
-inline float softLimit(float x) {
-  return x * (27.f + x * x) / (27.f + 9.f * x * x);
-}
-
-/** Soft Clipping function extracted from pichenettes/stmlib via daisysp */
-inline float softClip(float x) {
-  if (x < -3.0f)
-    return -1.0f;
-  else if (x > 3.0f)
-    return 1.0f;
-  else
-    return softLimit(x);
-}
-
 /** Ported from pichenettes/eurorack/plaits/dsp/oscillator/oscillator.h
  */
 inline float thisBlepSample(float t) {
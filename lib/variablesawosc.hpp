@@ -2,6 +2,7 @@
 #define PLATFORM_VARIABLESAWOSC_H
 
 #include <cmath>
+#include "phase.hpp"
 #include "utils.hpp"
 
 
@@ -21,7 +22,7 @@ class VariableSawOscillator {
   void init(float sampleRateIn) {
     sampleRate = sampleRateIn;
 
-    phase = 0.0f;
+    phaseAccumulator.init(sampleRate);
     nextSample = 0.0f;
     previousPW = 0.5f;
     high = false;
@@ -41,9 +42,12 @@ class VariableSawOscillator {
     const float slopeUp = 1.0f / (pw);
     const float slopeDown = 1.0f / (1.0f - pw);
 
-    phase += frequency;
+    // the end of the cycle is the accumulator wrapping, the blep positions
+    // are worked out from its phase as a float
+    bool wrapped = phaseAccumulator.process();
+    float phase = phaseAccumulator.getPhase();
 
-    if (!high && phase >= pw) {
+    if (!high && !wrapped && phase >= pw) {
       const float triangleStep = (slopeUp + slopeDown) * frequency * triangleAmount;
       const float notch = (variableSawNotchDepth + 1.0f - pw) * notchAmount;
       const float t = (phase - pw) / (previousPW - pw + frequency);
@@ -52,8 +56,7 @@ class VariableSawOscillator {
       thisSample -= triangleStep * thisIntegratedBlepSample(t);
       nextSample -= triangleStep * nextIntegratedBlepSample(t);
       high = true;
-    } else if (phase >= 1.0f) {
-      phase -= 1.0f;
+    } else if (wrapped) {
       const float triangleStep = (slopeUp + slopeDown) * frequency * triangleAmount;
       const float notch = (variableSawNotchDepth + 1.0f) * notchAmount;
       const float t = phase / frequency;
@@ -80,6 +83,7 @@ class VariableSawOscillator {
     newFrequency = newFrequency >= .25f ? .25f : newFrequency;
     pw = newFrequency >= .25f ? .5f : pw;
     frequency = newFrequency;
+    phaseAccumulator.setFreq(frequency * sampleRate);
   }
 
   /** Adjust the wave depending on the shape
@@ -116,7 +120,7 @@ class VariableSawOscillator {
   float sampleRate;
 
   // Oscillator state.
-  float phase;
+  PhaseAccumulator phaseAccumulator;
   float nextSample;
   float previousPW;
   bool high;
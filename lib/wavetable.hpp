@@ -0,0 +1,414 @@
+#ifndef PLATFORM_WAVETABLE_H
+#define PLATFORM_WAVETABLE_H
+
+#include <math.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/types.h>
+
+#include <type_traits>
+#include <vector>
+
+#include "fixed.hpp"
+#include "oscillator.hpp"
+#include "phase.hpp"
+#include "profile.hpp"
+
+namespace platform {
+
+/*
+Band-limited single cycle tables, one per octave of frequency ("mip-mapped").
+Every level only has as many harmonics as fit below the Nyquist frequency for
+the octave it gets used in, so reading them doesn't alias (much, see
+wavetableBandwidth). The levels are built with additive synthesis the first
+time a waveform gets asked for, which is at startup when the oscillators get
+their waveform.
+*/
+const uint wavetableBits = 9;
+const uint wavetableSize = 1 << wavetableBits;
+const uint wavetableFractionBits = 32 - wavetableBits;
+
+// The harmonics of a level reach up to this fraction of the sample rate at
+// the top of the octave it's used for, and half that at the bottom. Above the
+// Nyquist frequency they fold back down, but no lower than 1/3 of the sample
+// rate, where there's hardly anything left to hear. At the bottom of the octave
+// that leaves the harmonics up to 1/3 of the sample rate, instead of 1/4 if
+// nothing was allowed to fold back.
+const float wavetableBandwidth = 2.f / 3.f;
+
+// The lowest level has as many harmonics as fit into the table, and every
+// level up has half as many. The top one is a sine.
+const uint wavetableHarmonics = wavetableSize / 2 - 1;
+const uint wavetableLevels = 8;
+
+enum WavetableShape {
+  WAVETABLE_SINE,
+  // falling, from 1 to -1 like Oscillator::WAVE_SAW
+  WAVETABLE_SAW,
+  // 1 at the start and end of the cycle and -1 in the middle
+  WAVETABLE_TRIANGLE,
+  WAVETABLE_LAST,
+};
+
+struct Wavetable {
+  explicit Wavetable(WavetableShape shape) {
+    // the sine first, every harmonic gets read from it
+    float sine[wavetableSize];
+    for (uint i = 0; i < wavetableSize; i++) {
+      sine[i] = sinf(TWOPI_F * i / wavetableSize);
+    }
+
+    levels = shape == WAVETABLE_SINE ? 1 : wavetableLevels;
+    samples.assign(levels * (wavetableSize + 1), 0.f);
+    for (uint level = 0; level < levels; level++) {
+      float* table = &samples[level * (wavetableSize + 1)];
+      uint harmonics = shape == WAVETABLE_SINE ? 1 : getHarmonics(level);
+      for (uint n = 1; n <= harmonics; n++) {
+        float amplitude;
+        uint offset = 0;
+        if (shape == WAVETABLE_SINE) {
+          amplitude = 1.f;
+        } else if (shape == WAVETABLE_SAW) {
+          amplitude = 2.f / (M_PI * n);
+        } else {
+          if (!(n & 1)) {
+            continue;
+          }
+          amplitude = 8.f / (M_PI * M_PI * n * n);
+          // cosines
+          offset = wavetableSize / 4;
+        }
+        for (uint i = 0; i < wavetableSize; i++) {
+          table[i] += amplitude * sine[(n * i + offset) & (wavetableSize - 1)];
+        }
+      }
+      // so reading doesn't need to wrap for interpolating
+      table[wavetableSize] = table[0];
+    }
+  }
+
+  static uint getHarmonics(uint level) {
+    uint harmonics = wavetableHarmonics >> level;
+    return harmonics ? harmonics : 1;
+  }
+
+  // the highest phase increment (in cycles per sample, times 2^32) a level is
+  // good for
+  static uint32_t getMaxIncrement(uint level) {
+    if (level + 1 >= wavetableLevels) {
+      return UINT32_MAX;
+    }
+    return (uint32_t)(wavetableBandwidth / getHarmonics(level) * 4294967296.f);
+  }
+
+  // the level for a phase increment (its magnitude)
+  static uint getLevelFor(uint32_t increment) {
+    uint level = 0;
+    while (increment > getMaxIncrement(level)) {
+      level++;
+    }
+    return level;
+  }
+
+  const float* getLevel(uint level) const {
+    if (level >= levels) {
+      level = levels - 1;
+    }
+    return &samples[level * (wavetableSize + 1)];
+  }
+
+  uint levels;
+  std::vector<float> samples;
+};
+
+// Only built the first time each shape is asked for, so the ones nothing uses
+// don't take up any memory
+inline const Wavetable& getWavetable(WavetableShape shape) {
+  switch (shape) {
+    case WAVETABLE_SAW: {
+      static const Wavetable saw(WAVETABLE_SAW);
+      return saw;
+    }
+    case WAVETABLE_TRIANGLE: {
+      static const Wavetable triangle(WAVETABLE_TRIANGLE);
+      return triangle;
+    }
+    default: {
+      static const Wavetable sine(WAVETABLE_SINE);
+      return sine;
+    }
+  }
+}
+
+/*
+The same tables as 16 bit Q14 (1.0 is 1 << 14, the saw's overshoot needs a bit
+more than 1) for FixedWavetableOscillator. Half the size of the float ones,
+which only exist while these get built.
+*/
+struct FixedWavetable {
+  static const int fractionBits = 14;
+
+  explicit FixedWavetable(WavetableShape shape) {
+    Wavetable source(shape);
+    levels = source.levels;
+    samples.resize(source.samples.size());
+    for (size_t i = 0; i < samples.size(); i++) {
+      samples[i] = (q15)lrintf(source.samples[i] * (1 << fractionBits));
+    }
+  }
+
+  const q15* getLevel(uint level) const {
+    if (level >= levels) {
+      level = levels - 1;
+    }
+    return &samples[level * (wavetableSize + 1)];
+  }
+
+  uint levels;
+  std::vector<q15> samples;
+};
+
+inline const FixedWavetable& getFixedWavetable(WavetableShape shape) {
+  switch (shape) {
+    case WAVETABLE_SAW: {
+      static const FixedWavetable saw(WAVETABLE_SAW);
+      return saw;
+    }
+    case WAVETABLE_TRIANGLE: {
+      static const FixedWavetable triangle(WAVETABLE_TRIANGLE);
+      return triangle;
+    }
+    default: {
+      static const FixedWavetable sine(WAVETABLE_SINE);
+      return sine;
+    }
+  }
+}
+
+// Reads a level at a phase, interpolating linearly between the two points
+// around it
+inline float readWavetable(const float* table, uint32_t at) {
+  uint32_t index = at >> wavetableFractionBits;
+  float fraction = (at & ((1 << wavetableFractionBits) - 1)) * (1.f / (1 << wavetableFractionBits));
+  float a = table[index];
+  return a + (table[index + 1] - a) * fraction;
+}
+
+// The same for a FixedWavetable level, in Q27
+inline q27 readWavetable(const q15* table, uint32_t at) {
+  uint32_t index = at >> wavetableFractionBits;
+  // the two points as one (little endian) word, each weighted by a Q14
+  // fraction, which makes a Q28
+  const int weightBits = FixedWavetable::fractionBits;
+  uint32_t weight = (at >> (wavetableFractionBits - weightBits)) & ((1 << weightBits) - 1);
+  uint32_t points;
+  memcpy(&points, &table[index], sizeof(points));
+  return smlad(points, packQ15((1 << weightBits) - weight, weight), 0) >> 1;
+}
+
+/*
+Drop-in for Oscillator that reads from the band-limited tables above instead
+of computing the waveform every sample: no sinf(), no polyBLEP and no switch
+per sample, and less aliasing than the polyBLEP waveforms. The phase is a
+PhaseAccumulator, whose top bits index the table and the rest interpolate.
+
+The table level for the frequency only gets picked again when setFreq() leaves
+the octave the current one is good for. The instruments set the frequency once
+per control tick or ramp it, so that is rare.
+
+The naive and the POLYBLEP waveforms of Oscillator are the same here. Squares
+are the difference of two saws pw apart, so the pulse width still works.
+
+Sample is float for WavetableOscillator, or q27 for FixedWavetableOscillator,
+which reads the Q14 tables and interpolates between two points with a single
+smlad() and returns Q27 (see fixed.hpp).
+*/
+template <typename Sample>
+class BasicWavetableOscillator {
+  static constexpr bool isFixed = !std::is_floating_point_v<Sample>;
+  using Table = std::conditional_t<isFixed, FixedWavetable, Wavetable>;
+  using TableSample = std::conditional_t<isFixed, q15, float>;
+
+  public:
+  BasicWavetableOscillator() {}
+  ~BasicWavetableOscillator() {}
+
+  enum {
+    WAVE_SIN = Oscillator::WAVE_SIN,
+    WAVE_TRI = Oscillator::WAVE_TRI,
+    WAVE_SAW = Oscillator::WAVE_SAW,
+    WAVE_RAMP = Oscillator::WAVE_RAMP,
+    WAVE_SQUARE = Oscillator::WAVE_SQUARE,
+    WAVE_POLYBLEP_TRI = Oscillator::WAVE_POLYBLEP_TRI,
+    WAVE_POLYBLEP_SAW = Oscillator::WAVE_POLYBLEP_SAW,
+    WAVE_POLYBLEP_SQUARE = Oscillator::WAVE_POLYBLEP_SQUARE,
+    WAVE_LAST = Oscillator::WAVE_LAST,
+  };
+
+  // same defaults as Oscillator: 100Hz, 0.5 amplitude, sine
+  void init(float sampleRate) {
+    amp = 0.5f;
+    phaseAccumulator.init(sampleRate);
+    eoc = true;
+    eor = true;
+    setPw(0.5f);
+    setWaveform(WAVE_SIN);
+    setFreq(100.0f);
+  }
+
+  inline void setFreq(const float f) {
+    phaseAccumulator.setFreq(f);
+    uint32_t magnitude = getIncrementMagnitude();
+    if (magnitude > levelMaxIncrement || magnitude <= levelMinIncrement) {
+      selectLevel(magnitude);
+    }
+  }
+
+  inline void setAmp(const float a) {
+    amp = a;
+    updateGain();
+  }
+
+  // builds the tables for the waveform if nothing has used them yet, so call
+  // this at startup rather than from the audio path
+  void setWaveform(const uint8_t wf) {
+    waveform = wf < WAVE_LAST ? wf : WAVE_SIN;
+    switch (waveform) {
+      case WAVE_TRI:
+      case WAVE_POLYBLEP_TRI:
+        wavetable = &getTable(WAVETABLE_TRIANGLE);
+        break;
+      case WAVE_SAW:
+      case WAVE_RAMP:
+      case WAVE_SQUARE:
+      case WAVE_POLYBLEP_SAW:
+      case WAVE_POLYBLEP_SQUARE:
+        wavetable = &getTable(WAVETABLE_SAW);
+        break;
+      default:
+        wavetable = &getTable(WAVETABLE_SINE);
+        break;
+    }
+    isSquare = waveform == WAVE_SQUARE || waveform == WAVE_POLYBLEP_SQUARE;
+    updateGain();
+    selectLevel(getIncrementMagnitude());
+  }
+
+  inline void setPw(const float pwIn) {
+    pw = fclamp(pwIn, 0.0f, 1.0f);
+    pwPhase = (uint32_t)(int64_t)(pw * 4294967296.f);
+    // the two saws only cancel out to -1..1 with this added
+    if constexpr (isFixed) {
+      pwOffset = floatToQ27(2.f * pw - 1.f);
+    } else {
+      pwOffset = 2.f * pw - 1.f;
+    }
+  }
+
+  inline bool isEOR() {
+    return eor;
+  }
+
+  inline bool isEOC() {
+    return eoc;
+  }
+
+  inline bool isRising() {
+    return phaseAccumulator.isRising();
+  }
+
+  inline bool isFalling() {
+    return !phaseAccumulator.isRising();
+  }
+
+  Sample process() {
+    PROFILE_SCOPE("oscillator");
+    uint32_t phase = phaseAccumulator.phase;
+    Sample out = read(phase);
+    if (isSquare) {
+      out = out - read(phase - pwPhase) + pwOffset;
+    }
+
+    eoc = phaseAccumulator.process();
+    eor = phase < PhaseAccumulator::half && !phaseAccumulator.isRising();
+
+    if constexpr (isFixed) {
+      return mulShift<30>(out, gain);
+    } else {
+      return out * gain;
+    }
+  }
+
+  float getPhase() {
+    return phaseAccumulator.getPhase();
+  }
+
+  // adds a value 0.0-1.0 (equivalent to 0.0-TWO_PI) to the current phase
+  void phaseAdd(float phaseIn) {
+    phaseAccumulator.add(phaseIn);
+  }
+
+  void reset(float phaseIn = 0.0f) {
+    phaseAccumulator.reset(phaseIn);
+  }
+
+  private:
+  static const Table& getTable(WavetableShape shape) {
+    if constexpr (isFixed) {
+      return getFixedWavetable(shape);
+    } else {
+      return getWavetable(shape);
+    }
+  }
+
+  inline Sample read(uint32_t at) const {
+    return readWavetable(table, at);
+  }
+
+  inline uint32_t getIncrementMagnitude() const {
+    uint32_t increment = phaseAccumulator.increment;
+    return (int32_t)increment < 0 ? -increment : increment;
+  }
+
+  void selectLevel(uint32_t magnitude) {
+    uint level = Wavetable::getLevelFor(magnitude);
+    levelMinIncrement = level ? Wavetable::getMaxIncrement(level - 1) : 0;
+    levelMaxIncrement = Wavetable::getMaxIncrement(level);
+    table = wavetable->getLevel(level);
+  }
+
+  void updateGain() {
+    float floatGain = amp;
+    // Oscillator's ramp and its integrated polyBLEP triangle are upside down
+    if (waveform == WAVE_RAMP || waveform == WAVE_POLYBLEP_TRI) {
+      floatGain = -floatGain;
+    } else if (waveform == WAVE_POLYBLEP_SQUARE) {
+      // like Oscillator
+      floatGain *= 0.707f;
+    }
+    if constexpr (isFixed) {
+      gain = floatToFixed<30>(floatGain);
+    } else {
+      gain = floatGain;
+    }
+  }
+
+  uint8_t waveform;
+  bool isSquare;
+  const Table* wavetable;
+  const TableSample* table;
+  uint32_t levelMinIncrement, levelMaxIncrement;
+  float amp, pw;
+  // Q30 and Q27 for the fixed point one
+  Sample gain, pwOffset;
+  PhaseAccumulator phaseAccumulator;
+  uint32_t pwPhase;
+  bool eor, eoc;
+};
+
+using WavetableOscillator = BasicWavetableOscillator<float>;
+using FixedWavetableOscillator = BasicWavetableOscillator<q27>;
+
+}  // namespace platform
+
+#endif  // PLATFORM_WAVETABLE_H
@@ -23,15 +23,27 @@
 #include "pico/stdlib.h"
 #include "pico/rand.h"
 
+#ifdef PLATFORM16_MULTICORE
+#include "pico/multicore.h"
+#endif
+
 #include "lib/gpio.hpp"
 #include "lib/pots.hpp"
 #include "lib/buttons.hpp"
+#include "lib/allocguard.hpp"
+#include "lib/fixed.hpp"
+#include "lib/loadmonitor.hpp"
+#include "lib/profile.hpp"
 //#include "firmware/sds/sds-instrument.hpp"
 //#include "firmware/pmd/pmd-instrument.hpp"
 #include "firmware/tep/tep-instrument.hpp"
 
 using namespace platform;
 
+//using Instrument = platform::SDSInstrument;
+//using Instrument = platform::PMDInstrument;
+using Instrument = platform::TEPInstrument;
+
 bi_decl(bi_3pins_with_names(PICO_AUDIO_I2S_DATA_PIN,
                             "I2S DIN",
                             PICO_AUDIO_I2S_CLOCK_PIN_BASE,
@@ -44,6 +56,7 @@ bi_decl(bi_3pins_with_names(PICO_AUDIO_I2S_DATA_PIN,
 // 48000 = 0.016 seconds. Which is about the worst case amount that two periods
 // of a reconstructed / synthetic clock signal could be off by.
 #define SAMPLES_PER_BUFFER 256
+#define BUFFER_COUNT 3
 
 struct audio_buffer_pool* init_audio() {
 
@@ -57,7 +70,7 @@ struct audio_buffer_pool* init_audio() {
 
   struct audio_buffer_pool* producer_pool =
     audio_new_producer_pool(&producer_format,
-                            3,
+                            BUFFER_COUNT,
                             SAMPLES_PER_BUFFER);  // todo correct size
   bool __unused ok;
   const struct audio_format* output_format;
@@ -80,11 +93,92 @@ struct audio_buffer_pool* init_audio() {
 }
 
 
-int main() {
-  // we could also just use get_rand_32() everywhere, but I'm just using it to
-  // get a random seed for the c rand() function for now
-  srand(get_rand_32());
+platform::LoadMonitor loadMonitor;
+
+// Renders the next buffer and hands it to the audio output. The boot button
+// gets updated for the buffer first so the instrument sees its events while
+// rendering it (see lib/buttons.hpp).
+void renderBuffer(struct audio_buffer_pool* ap,
+                  Instrument& instrument,
+                  platform::ButtonInput& bootButton,
+                  float* block) {
+  auto start = time_us_64();
+  struct audio_buffer* buffer = take_audio_buffer(ap, true);
+  auto end = time_us_64();
+  loadMonitor.beginBuffer(end - start, end);
+
+  platform::updateBootButton(bootButton, buffer->max_sample_count);
+  {
+    NO_ALLOC_SCOPE();
+    instrument.processBlock(block, buffer->max_sample_count);
+  }
+  bootButton.clearEvents();
+
+  int16_t* samples = (int16_t*)buffer->buffer->bytes;
+  for (uint i = 0; i < buffer->max_sample_count; i++) {
+    int16_t sampleInt = platform::floatToSample16(block[i]);
+    samples[i * 2] = sampleInt;
+    samples[i * 2 + 1] = sampleInt;
+  }
+  buffer->sample_count = buffer->max_sample_count;
+
+  give_audio_buffer(ap, buffer);
+  loadMonitor.endBuffer(time_us_64());
+  profiler.endBuffer();
+}
+
+// Send an l over USB serial to get a load report (see lib/loadmonitor.hpp) or a
+// p for a profile (see lib/profile.hpp).
+void processSerial() {
+  int c = getchar_timeout_us(0);
+  if (c == 'l') {
+    loadMonitor.requestReport();
+  } else if (c == 'p') {
+    profiler.requestReport();
+  }
+  if (loadMonitor.acquireReport()) {
+    loadMonitor.printReport();
+  }
+  if (profiler.acquireReport()) {
+    profiler.printReport();
+  }
+}
+
+#ifdef PLATFORM16_MULTICORE
+/*
+Core 1 owns the audio: it sets up I2S (so the DMA interrupt runs on core 1 too),
+runs the instrument and fills the audio buffers. Core 0 reads the pots and runs
+the controller, which means the ADC reads and their settling time no longer come
+out of the audio budget, and is free for logging.
+
+The boot button's ButtonInput belongs to core 1: it gets updated in
+renderBuffer() and only read from processBlock(). Core 0 (the controller in
+update()) must not touch it.
+
+The instrument's state goes across through its StateChannel. Core 1 pushes a
+token through the SIO FIFO at the start of every buffer so that core 0 still
+processes the pots once per buffer like in single core mode.
+*/
+Instrument* audioInstrument;
+platform::ButtonInput* audioBootButton;
+
+void core1Main() {
+  startProfileTime();
+  struct audio_buffer_pool* ap = init_audio();
+  float block[SAMPLES_PER_BUFFER];
+
+  while (true) {
+    // if core 0 is still busy with the last one it can skip this one
+    if (multicore_fifo_wready()) {
+      multicore_fifo_push_blocking(0);
+    }
 
+    renderBuffer(ap, *audioInstrument, *audioBootButton, block);
+  }
+}
+#endif
+
+int main() {
   // TODO: can we make this optional and only enable for debugging?
   stdio_init_all();
 
@@ -108,61 +202,47 @@ int main() {
   gpio_set_dir(CLOCK_OUT_PIN, GPIO_OUT);
   gpio_put(CLOCK_OUT_PIN, false);
 
+  startProfileTime();
+
   platform::Pots pots(S0_PIN, S1_PIN, S2_PIN, S3_PIN);
   pots.init();
   platform::ButtonInput bootButton;
-  //platform::SDSInstrument instrument(pots, bootButton);
-  //platform::PMDInstrument instrument(pots, bootButton);
-  platform::TEPInstrument instrument(pots, bootButton);
+
+#ifdef PLATFORM16_MULTICORE
+  Instrument instrument(pots, bootButton);
+  instrument.init(SAMPLE_RATE);
+  loadMonitor.init(SAMPLE_RATE, SAMPLES_PER_BUFFER, BUFFER_COUNT);
+  instrument.update();
+
+  audioInstrument = &instrument;
+  audioBootButton = &bootButton;
+  multicore_launch_core1(core1Main);
+
+  while (true) {
+    multicore_fifo_pop_blocking();
+
+    pots.process();
+    instrument.update();
+    processSerial();
+  }
+#else
+  Instrument instrument(pots, bootButton);
   instrument.init(SAMPLE_RATE);
+  loadMonitor.init(SAMPLE_RATE, SAMPLES_PER_BUFFER, BUFFER_COUNT);
 
   struct audio_buffer_pool* ap = init_audio();
-  auto tickStart = time_us_64();
-  uint64_t total = 0;
+
+  float block[SAMPLES_PER_BUFFER];
 
   while (true) {
-    bool bootButtonState = false;
     pots.process();
     instrument.update();
 
-    auto start = time_us_64();
-    struct audio_buffer* buffer = take_audio_buffer(ap, true);
-    auto end = time_us_64();
-    auto timeTaken = end - start;
-    total += timeTaken;
-
-    int16_t* samples = (int16_t*)buffer->buffer->bytes;
-    for (uint i = 0; i < buffer->max_sample_count; i++) {
-      // checking the boot button is quite slow, so how frequently we check it
-      // is a compromise and unfortunately that means we can miss quick presses
-      if (i % 16 == 0) {
-        bootButtonState = getBootButton();
-      }
-      bootButton.update(bootButtonState);
-      float sample = instrument.process();
-      int16_t sampleInt = (int16_t)(sample * 32767.f);
-      samples[i * 2] = sampleInt;
-      samples[i * 2 + 1] = sampleInt;
-    }
-    buffer->sample_count = buffer->max_sample_count;
-
-    start = time_us_64();
-    give_audio_buffer(ap, buffer);
-    end = time_us_64();
-    timeTaken = end - start;
-    total += timeTaken;
-    
-    if (end - tickStart > 1000000) {
-      // this is how long we busy-waited for the audio buffers to drain in the
-      // last second because they were all full. ie. roughly how much of each
-      // second we have "spare"
-      //printf("%.2fms\n", total/1000.f);
-      // TODO: should we somehow take into account the remainder?
-      total = 0;
-      tickStart = end; 
-    }
+    renderBuffer(ap, instrument, bootButton, block);
+    processSerial();
   }
+#endif
 
   puts("\n");
   return 0;
-}
\ No newline at end of file
+}